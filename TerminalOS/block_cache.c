@@ -0,0 +1,558 @@
+/* block_cache.c
+ * Block cache between the file systems and their block devices.
+ * Blocks are looked up by (device, block number), replaced least
+ * recently used first and written back to their device when dirty.
+ */
+
+#include "block_cache.h"
+
+/***************************BLOCK CACHE GLOBAL VARIABLES*****************************/
+
+//Cached block data
+uint8_t bcache_data[BCACHE_BLOCKS][BLOCK_SIZE] __attribute__((aligned (4096)));
+
+//Cache entries, hash buckets and LRU list ends
+bcache_entry_t bcache_entries[BCACHE_BLOCKS];
+bcache_entry_t * bcache_hash[BCACHE_BUCKETS];
+bcache_entry_t * lru_head = NULL;
+bcache_entry_t * lru_tail = NULL;
+
+//Readahead requests waiting for the timer, read from head and added at tail
+bcache_prefetch_t prefetch_queue[BCACHE_PREFETCH_QUEUE];
+uint32_t prefetch_head = 0;
+uint32_t prefetch_count = 0;
+
+//Cache counters
+bcache_stats_t bcache_stats;
+
+/***************************PRIVATE BLOCK CACHE FUNCTIONS****************************/
+
+/*
+ * bcache_bucket
+ *   DESCRIPTION:	Hashes a (device, block) pair to a bucket
+ *   INPUTS:		dev   - block device
+ *					block - block number on the device
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Bucket index
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t bcache_bucket(block_dev_t * dev, uint32_t block){
+	return (block ^ ((uint32_t)dev >> 4)) & (BCACHE_BUCKETS - 1);
+}
+
+/*
+ * lru_remove
+ *   DESCRIPTION:	Takes an entry out of the LRU list
+ *   INPUTS:		entry - cache entry
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	LRU list changes
+ */
+static void lru_remove(bcache_entry_t * entry){
+	if (entry -> prev != NULL)
+		entry -> prev -> next = entry -> next;
+	else
+		lru_head = entry -> next;
+	
+	if (entry -> next != NULL)
+		entry -> next -> prev = entry -> prev;
+	else
+		lru_tail = entry -> prev;
+}
+
+/*
+ * lru_push_front
+ *   DESCRIPTION:	Makes an entry the most recently used
+ *   INPUTS:		entry - cache entry not in the LRU list
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	LRU list changes
+ */
+static void lru_push_front(bcache_entry_t * entry){
+	entry -> prev = NULL;
+	entry -> next = lru_head;
+	if (lru_head != NULL)
+		lru_head -> prev = entry;
+	lru_head = entry;
+	if (lru_tail == NULL)
+		lru_tail = entry;
+}
+
+/*
+ * hash_remove
+ *   DESCRIPTION:	Takes a valid entry out of its hash bucket
+ *   INPUTS:		entry - cache entry
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Hash bucket changes
+ */
+static void hash_remove(bcache_entry_t * entry){
+	bcache_entry_t ** link = &bcache_hash[bcache_bucket(entry -> dev, entry -> block)];
+	while (*link != NULL)
+	{
+		if (*link == entry)
+		{
+			*link = entry -> hash_next;
+			break;
+		}
+		link = &((*link) -> hash_next);
+	}
+	entry -> hash_next = NULL;
+}
+
+/*
+ * write_back
+ *   DESCRIPTION:	Writes a dirty entry to its device
+ *   INPUTS:		entry - cache entry
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the device write failed
+ *   SIDE EFFECTS:	Entry is clean on success
+ */
+static int32_t write_back(bcache_entry_t * entry){
+	if (!entry -> valid || !entry -> dirty)
+		return 0;
+	
+	if (entry -> dev -> write_block == NULL || entry -> dev -> write_block(entry -> dev, entry -> block, entry -> data) == -1)
+		return -1;
+	
+	entry -> dirty = 0;
+	bcache_stats.writebacks++;
+	return 0;
+}
+
+/*
+ * bcache_lookup
+ *   DESCRIPTION:	Finds a block in the cache without touching the LRU list
+ *   INPUTS:		dev   - block device
+ *					block - block number on the device
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Cache entry holding the block, NULL if it isn't cached
+ *   SIDE EFFECTS:	None
+ */
+static bcache_entry_t * bcache_lookup(block_dev_t * dev, uint32_t block){
+	bcache_entry_t * entry = bcache_hash[bcache_bucket(dev, block)];
+	while (entry != NULL)
+	{
+		if (entry -> dev == dev && entry -> block == block)
+			return entry;
+		entry = entry -> hash_next;
+	}
+	return NULL;
+}
+
+/*
+ * bcache_replace
+ *   DESCRIPTION:	Replaces the least recently used entry with a block that
+ *					isn't cached. The block is only read from the device if
+ *					fill is set.
+ *   INPUTS:		dev   - block device
+ *					block - block number on the device
+ *					fill  - 1 to read the block's contents
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Cache entry holding the block, NULL on failure
+ *   SIDE EFFECTS:	Entry becomes most recently used, an evicted dirty block
+ *					is written back (must be called with interrupts off)
+ */
+static bcache_entry_t * bcache_replace(block_dev_t * dev, uint32_t block, uint32_t fill){
+	bcache_entry_t * entry = lru_tail;
+	if (entry -> valid)
+	{
+		if (write_back(entry) == -1)
+			return NULL;
+		hash_remove(entry);
+		bcache_stats.evictions++;
+	}
+	
+	entry -> dev = dev;
+	entry -> block = block;
+	entry -> dirty = 0;
+	entry -> prefetched = 0;
+	entry -> valid = 0;
+	
+	//a failed read leaves the invalid entry at the tail to be reused first
+	if (fill && dev -> read_block(dev, block, entry -> data) == -1)
+		return NULL;
+	
+	entry -> valid = 1;
+	
+	uint32_t bucket = bcache_bucket(dev, block);
+	entry -> hash_next = bcache_hash[bucket];
+	bcache_hash[bucket] = entry;
+	
+	lru_remove(entry);
+	lru_push_front(entry);
+	return entry;
+}
+
+/*
+ * bcache_get
+ *   DESCRIPTION:	Finds a block in the cache, or replaces the least recently
+ *					used entry with it. The block is only read from the device
+ *					if fill is set.
+ *   INPUTS:		dev   - block device
+ *					block - block number on the device
+ *					fill  - 1 to read the block's contents on a miss
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Cache entry holding the block, NULL on failure
+ *   SIDE EFFECTS:	Entry becomes most recently used, counters are updated,
+ *					an evicted dirty block is written back
+ *					(must be called with interrupts off)
+ */
+static bcache_entry_t * bcache_get(block_dev_t * dev, uint32_t block, uint32_t fill){
+	if (dev == NULL || block >= dev -> num_blocks)
+		return NULL;
+	
+	bcache_entry_t * entry = bcache_lookup(dev, block);
+	if (entry != NULL)
+	{
+		bcache_stats.hits++;
+		if (entry -> prefetched)
+		{
+			bcache_stats.prefetch_hits++;
+			entry -> prefetched = 0;
+		}
+		lru_remove(entry);
+		lru_push_front(entry);
+		return entry;
+	}
+	
+	bcache_stats.misses++;
+	return bcache_replace(dev, block, fill);
+}
+
+/*
+ * ramdisk_read_block
+ *   DESCRIPTION:	Copies a block of a memory resident device
+ *   INPUTS:		dev   - ramdisk device
+ *					block - block number
+ *					buf   - 4KB buffer to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0
+ *   SIDE EFFECTS:	buf is filled
+ */
+static int32_t ramdisk_read_block(block_dev_t * dev, uint32_t block, uint8_t * buf){
+	memcpy(buf, (uint8_t *)(dev -> base + (block * BLOCK_SIZE)), BLOCK_SIZE);
+	return 0;
+}
+
+/*
+ * ramdisk_write_block
+ *   DESCRIPTION:	Stores a block in a memory resident device
+ *   INPUTS:		dev   - ramdisk device
+ *					block - block number
+ *					buf   - 4KB of data to store
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0
+ *   SIDE EFFECTS:	Device memory changes
+ */
+static int32_t ramdisk_write_block(block_dev_t * dev, uint32_t block, const uint8_t * buf){
+	memcpy((uint8_t *)(dev -> base + (block * BLOCK_SIZE)), buf, BLOCK_SIZE);
+	return 0;
+}
+
+/************************************************************************************/
+
+/*
+ * bcache_init
+ *   DESCRIPTION:	Empties the cache and its counters
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Every entry is invalid and in the LRU list
+ */
+void bcache_init(){
+	int i;
+	
+	lru_head = NULL;
+	lru_tail = NULL;
+	memset(bcache_hash, 0, sizeof(bcache_hash));
+	memset(&bcache_stats, 0, sizeof(bcache_stats));
+	prefetch_head = 0;
+	prefetch_count = 0;
+	
+	for (i = 0; i < BCACHE_BLOCKS; i++)
+	{
+		bcache_entries[i].dev = NULL;
+		bcache_entries[i].valid = 0;
+		bcache_entries[i].dirty = 0;
+		bcache_entries[i].prefetched = 0;
+		bcache_entries[i].data = bcache_data[i];
+		bcache_entries[i].hash_next = NULL;
+		lru_push_front(&bcache_entries[i]);
+	}
+}
+
+/*
+ * bcache_copy_from
+ *   DESCRIPTION:	Copies bytes of a block through the cache
+ *   INPUTS:		dev    - block device
+ *					block  - block number on the device
+ *					offset - first byte in the block
+ *					buf    - buffer to fill
+ *					len    - number of bytes (offset + len <= 4KB)
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes copied, -1 on failure
+ *   SIDE EFFECTS:	buf is filled, the block may be read into the cache
+ */
+int32_t bcache_copy_from(block_dev_t * dev, uint32_t block, uint32_t offset, uint8_t * buf, uint32_t len){
+	uint32_t flags;
+	
+	if (offset + len > BLOCK_SIZE)
+		return -1;
+	
+	cli_and_save(flags);
+	bcache_entry_t * entry = bcache_get(dev, block, 1);
+	if (entry == NULL)
+	{
+		restore_flags(flags);
+		return -1;
+	}
+	memcpy(buf, entry -> data + offset, len);
+	restore_flags(flags);
+	
+	return len;
+}
+
+/*
+ * bcache_copy_to
+ *   DESCRIPTION:	Copies bytes into a block through the cache. The block is
+ *					marked dirty and reaches its device when it is evicted or
+ *					synced. Overwriting a whole block doesn't read it first.
+ *   INPUTS:		dev    - block device
+ *					block  - block number on the device
+ *					offset - first byte in the block
+ *					buf    - bytes to store
+ *					len    - number of bytes (offset + len <= 4KB)
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes copied, -1 on failure
+ *   SIDE EFFECTS:	Cached block changes
+ */
+int32_t bcache_copy_to(block_dev_t * dev, uint32_t block, uint32_t offset, const uint8_t * buf, uint32_t len){
+	uint32_t flags;
+	
+	if (offset + len > BLOCK_SIZE)
+		return -1;
+	
+	cli_and_save(flags);
+	bcache_entry_t * entry = bcache_get(dev, block, len != BLOCK_SIZE);
+	if (entry == NULL)
+	{
+		restore_flags(flags);
+		return -1;
+	}
+	memcpy(entry -> data + offset, buf, len);
+	entry -> dirty = 1;
+	restore_flags(flags);
+	
+	return len;
+}
+
+/*
+ * bcache_zero
+ *   DESCRIPTION:	Fills bytes of a block with zeros through the cache
+ *   INPUTS:		dev    - block device
+ *					block  - block number on the device
+ *					offset - first byte in the block
+ *					len    - number of bytes (offset + len <= 4KB)
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes zeroed, -1 on failure
+ *   SIDE EFFECTS:	Cached block changes
+ */
+int32_t bcache_zero(block_dev_t * dev, uint32_t block, uint32_t offset, uint32_t len){
+	uint32_t flags;
+	
+	if (offset + len > BLOCK_SIZE)
+		return -1;
+	
+	cli_and_save(flags);
+	bcache_entry_t * entry = bcache_get(dev, block, len != BLOCK_SIZE);
+	if (entry == NULL)
+	{
+		restore_flags(flags);
+		return -1;
+	}
+	memset(entry -> data + offset, 0, len);
+	entry -> dirty = 1;
+	restore_flags(flags);
+	
+	return len;
+}
+
+/*
+ * bcache_sync
+ *   DESCRIPTION:	Writes every dirty cached block of a device back to it
+ *   INPUTS:		dev - block device
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if a write failed
+ *   SIDE EFFECTS:	Device contents change
+ */
+int32_t bcache_sync(block_dev_t * dev){
+	uint32_t flags;
+	int32_t retval = 0;
+	int i;
+	
+	cli_and_save(flags);
+	for (i = 0; i < BCACHE_BLOCKS; i++)
+	{
+		if (bcache_entries[i].dev == dev && write_back(&bcache_entries[i]) == -1)
+			retval = -1;
+	}
+	restore_flags(flags);
+	
+	return retval;
+}
+
+/*
+ * bcache_discard
+ *   DESCRIPTION:	Drops a block from the cache without writing it back, for
+ *					blocks whose contents are no longer needed (freed blocks)
+ *   INPUTS:		dev   - block device
+ *					block - block number on the device
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	The entry becomes invalid and is reused first
+ */
+void bcache_discard(block_dev_t * dev, uint32_t block){
+	uint32_t flags;
+	
+	cli_and_save(flags);
+	bcache_entry_t * entry = bcache_lookup(dev, block);
+	if (entry != NULL)
+	{
+		hash_remove(entry);
+		entry -> valid = 0;
+		entry -> dirty = 0;
+		entry -> prefetched = 0;
+		
+		//move to the tail so it is the next entry replaced
+		lru_remove(entry);
+		entry -> next = NULL;
+		entry -> prev = lru_tail;
+		if (lru_tail != NULL)
+			lru_tail -> next = entry;
+		lru_tail = entry;
+		if (lru_head == NULL)
+			lru_head = entry;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * bcache_prefetch
+ *   DESCRIPTION:	Asks for a block to be read into the cache ahead of use.
+ *					The read happens later, from the timer interrupt.
+ *   INPUTS:		dev   - block device
+ *					block - block number on the device
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 if the block is cached or queued, -1 if the queue is full
+ *   SIDE EFFECTS:	Request is added to the readahead queue
+ */
+int32_t bcache_prefetch(block_dev_t * dev, uint32_t block){
+	uint32_t flags;
+	
+	if (dev == NULL || block >= dev -> num_blocks)
+		return -1;
+	
+	cli_and_save(flags);
+	if (bcache_lookup(dev, block) != NULL)
+	{
+		restore_flags(flags);
+		return 0;
+	}
+	if (prefetch_count == BCACHE_PREFETCH_QUEUE)
+	{
+		bcache_stats.prefetch_drops++;
+		restore_flags(flags);
+		return -1;
+	}
+	
+	uint32_t tail = (prefetch_head + prefetch_count) % BCACHE_PREFETCH_QUEUE;
+	prefetch_queue[tail].dev = dev;
+	prefetch_queue[tail].block = block;
+	prefetch_count++;
+	restore_flags(flags);
+	
+	return 0;
+}
+
+/*
+ * bcache_run_prefetch
+ *   DESCRIPTION:	Reads up to BCACHE_PREFETCH_PER_TICK queued readahead
+ *					blocks into the cache. Called from the timer interrupt.
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Cache entries are replaced, the queue shrinks
+ */
+void bcache_run_prefetch(){
+	uint32_t flags;
+	int i;
+	
+	cli_and_save(flags);
+	for (i = 0; i < BCACHE_PREFETCH_PER_TICK && prefetch_count > 0; i++)
+	{
+		bcache_prefetch_t * req = &prefetch_queue[prefetch_head];
+		prefetch_head = (prefetch_head + 1) % BCACHE_PREFETCH_QUEUE;
+		prefetch_count--;
+		
+		//a read of the block may have beaten the timer to it
+		if (bcache_lookup(req -> dev, req -> block) != NULL)
+			continue;
+		
+		bcache_entry_t * entry = bcache_replace(req -> dev, req -> block, 1);
+		if (entry != NULL)
+		{
+			entry -> prefetched = 1;
+			bcache_stats.prefetches++;
+		}
+	}
+	restore_flags(flags);
+}
+
+/*
+ * bcache_get_stats
+ *   DESCRIPTION:	Copies the cache counters
+ *   INPUTS:		stats - bcache_stats_t struct to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+void bcache_get_stats(bcache_stats_t * stats){
+	if (stats != NULL)
+		*stats = bcache_stats;
+}
+
+/*
+ * print_bcache_stats
+ *   DESCRIPTION:	Prints the cache counters to display
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Prints to screen
+ */
+void print_bcache_stats(){
+	printf("\nhits      : %d", bcache_stats.hits);
+	printf("\nmisses    : %d", bcache_stats.misses);
+	printf("\nevictions : %d", bcache_stats.evictions);
+	printf("\nwritebacks: %d", bcache_stats.writebacks);
+	printf("\nprefetches: %d", bcache_stats.prefetches);
+	printf("\npf hits   : %d", bcache_stats.prefetch_hits);
+	printf("\npf drops  : %d\n", bcache_stats.prefetch_drops);
+}
+
+/*
+ * ramdisk_init
+ *   DESCRIPTION:	Sets up a block device over memory, such as a multiboot module
+ *   INPUTS:		dev        - block device to fill
+ *					base       - address of block 0
+ *					num_blocks - number of 4KB blocks
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+void ramdisk_init(block_dev_t * dev, uint32_t base, uint32_t num_blocks){
+	dev -> num_blocks = num_blocks;
+	dev -> read_block = &ramdisk_read_block;
+	dev -> write_block = &ramdisk_write_block;
+	dev -> base = base;
+}
@@ -0,0 +1,79 @@
+/* block_cache.h
+ * Header for the block cache shared by the file systems
+ */
+
+#ifndef _BLOCK_CACHE_H
+#define _BLOCK_CACHE_H
+
+#include "types.h"
+#include "lib.h"
+
+#define BLOCK_SIZE 4096
+
+//Number of 4KB blocks the cache holds
+#define BCACHE_BLOCKS 32
+
+//Hash buckets for (device, block) lookups (power of 2)
+#define BCACHE_BUCKETS 64
+
+//Pending readahead requests, and how many are read per timer tick
+#define BCACHE_PREFETCH_QUEUE 32
+#define BCACHE_PREFETCH_PER_TICK 8
+
+//Block device structure
+typedef struct block_dev{
+	//Number of 4KB blocks on the device
+	uint32_t num_blocks;
+
+	//Copy one block between the device and memory, 0 on success, -1 on failure
+	int32_t (*read_block)(struct block_dev * dev, uint32_t block, uint8_t * buf);
+	int32_t (*write_block)(struct block_dev * dev, uint32_t block, const uint8_t * buf);
+
+	//Address of block 0 for devices that live in memory (0 otherwise)
+	uint32_t base;
+}block_dev_t;
+
+//Cached block
+typedef struct bcache_entry{
+	block_dev_t * dev;
+	uint32_t block;
+	uint32_t valid;					//1 if data holds the block
+	uint32_t dirty;					//1 if data must be written back to the device
+	uint32_t prefetched;			//1 if read ahead and not used yet
+	uint8_t * data;
+	struct bcache_entry * prev;		//LRU list, head is most recently used
+	struct bcache_entry * next;
+	struct bcache_entry * hash_next;
+}bcache_entry_t;
+
+//Block cache counters
+typedef struct bcache_stats{
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;		//valid blocks replaced
+	uint32_t writebacks;	//dirty blocks written to their device
+	uint32_t prefetches;	//blocks read ahead
+	uint32_t prefetch_hits;	//read ahead blocks used before being evicted
+	uint32_t prefetch_drops;	//readahead requests lost to a full queue
+}bcache_stats_t;
+
+//Queued readahead request
+typedef struct bcache_prefetch{
+	block_dev_t * dev;
+	uint32_t block;
+}bcache_prefetch_t;
+
+void bcache_init();
+int32_t bcache_copy_from(block_dev_t * dev, uint32_t block, uint32_t offset, uint8_t * buf, uint32_t len);
+int32_t bcache_copy_to(block_dev_t * dev, uint32_t block, uint32_t offset, const uint8_t * buf, uint32_t len);
+int32_t bcache_zero(block_dev_t * dev, uint32_t block, uint32_t offset, uint32_t len);
+int32_t bcache_sync(block_dev_t * dev);
+void bcache_discard(block_dev_t * dev, uint32_t block);
+int32_t bcache_prefetch(block_dev_t * dev, uint32_t block);
+void bcache_run_prefetch();
+void bcache_get_stats(bcache_stats_t * stats);
+void print_bcache_stats();
+
+void ramdisk_init(block_dev_t * dev, uint32_t base, uint32_t num_blocks);
+
+#endif /* _BLOCK_CACHE_H */
@@ -4,52 +4,102 @@
  
 #include "directory.h"
 
-uint32_t num_entries = 0;
-int32_t cur_entry = 0;
-
 /*
  * dir_open
- *   DESCRIPTION:	Opens a new directory,
- *					initializing relevant values
- *   INPUTS:		None
+ *   DESCRIPTION:	Opens a new directory, starting its cursor
+ *					at the first entry
+ *   INPUTS:		file - file_t of the directory
  *   OUTPUTS:		None
  *   RETURN VALUE:	Returns 1
- *   SIDE EFFECTS:	None
+ *   SIDE EFFECTS:	file's position is reset
  */
-int32_t dir_open(){
-	num_entries = num_dir_entries();
-	cur_entry = 0;
+int32_t dir_open(file_t * file){
+	file -> f_pos = 0;
 	return 1;
 }
 
 /*
  * dir_read
  *   DESCRIPTION:	Reads a directory entry
- *   INPUTS:		Pointer to the buffer and size of buffer
+ *   INPUTS:		file   - open directory, f_pos is the entry to read
+ *					buf    - buffer to fill
+ *					nbytes - size of buffer
  *   OUTPUTS:		None
  *   RETURN VALUE:	0 if all directories have been read, 
  *					otherwise returns length of file name
  *					corresponding to the current directory
  *					entry.
  *   SIDE EFFECTS:	Copies file name into the buffer,
- *					changes the current directory
+ *					moves the file's cursor to the next entry
  */
-int32_t dir_read(void* buf, int32_t nbytes){
-	if(cur_entry >= num_entries){
+int32_t dir_read(file_t * file, void* buf, int32_t nbytes){
+	fs_select(file -> f_private);
+	if(file -> f_pos >= fs_dir_entries(&file -> f_dentry)){
 		return 0;    //already read all directory entries
 	}
 	
-	//get cur_entry
+	//get current entry
 	dentry_t entry;
-	read_dentry_by_dir_index(cur_entry, &entry);
+	if(fs_read_dir(&file -> f_dentry, file -> f_pos, &entry) == -1){
+		return 0;
+	}
 	
 	//fill buf with dentry name
 	strncpy(buf, entry.file_name, 32);
 	
-	cur_entry++;
+	file -> f_pos++;
 	return strlen(entry.file_name);
 }
 
+/*
+ * dir_getdents
+ *   DESCRIPTION:	Fills buf with as many directory entry records as fit,
+ *					continuing from the file's cursor
+ *   INPUTS:		file   - open directory, f_pos is the next entry to read
+ *					buf    - buffer to fill with dirent_t records
+ *					nbytes - size of buffer
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes filled, 0 if all entries have been
+ *					read, -1 if buf can't hold a single record
+ *   SIDE EFFECTS:	Moves the file's cursor past the entries returned
+ */
+int32_t dir_getdents(file_t * file, void* buf, int32_t nbytes){
+	if(buf == NULL || nbytes < 0){
+		return -1;
+	}
+	fs_select(file -> f_private);
+	
+	int32_t num_entries = fs_dir_entries(&file -> f_dentry);
+	if(file -> f_pos >= num_entries){
+		return 0;    //already read all directory entries
+	}
+	if(nbytes < sizeof(dirent_t)){
+		return -1;
+	}
+	
+	dirent_t * record = (dirent_t *)buf;
+	uint32_t count = nbytes / sizeof(dirent_t);
+	uint32_t i;
+	for(i = 0; i < count && file -> f_pos < num_entries; i++){
+		dentry_t entry;
+		if(fs_read_dir(&file -> f_dentry, file -> f_pos, &entry) == -1){
+			break;
+		}
+		
+		memcpy(record[i].name, entry.file_name, 32);
+		record[i].type = entry.file_type;
+		record[i].inode = entry.inode_num;
+		record[i].size = 0;
+		if(entry.file_type == 2){
+			record[i].size = file_size(entry.inode_num);
+		}
+		
+		file -> f_pos++;
+	}
+	
+	return i * sizeof(dirent_t);
+}
+
 /*
  * dir_write
  *   DESCRIPTION:	Not used or implemented.
@@ -58,18 +108,53 @@ int32_t dir_read(void* buf, int32_t nbytes){
  *   RETURN VALUE: 	Returns -1 as it should not be called.
  *   SIDE EFFECTS:	None
  */
-int32_t dir_write(const void* buf, int32_t nbytes){
+int32_t dir_write(file_t * file, const void* buf, int32_t nbytes){
 	return -1;
 }
 
 /*
  * dir_close
- *   DESCRIPTION:	Not used or implemented.
- *   INPUTS: 		None
+ *   DESCRIPTION:	Closes a directory, it holds nothing to release
+ *   INPUTS: 		file - open directory
  *   OUTPUTS:		None
- *   RETURN VALUE: 	Returns -1 as it should not be called.
+ *   RETURN VALUE: 	0
  *   SIDE EFFECTS:	None
  */
-int32_t dir_close(){
-	return -1;
+int32_t dir_close(file_t * file){
+	return 0;
+}
+
+/*
+ * dir_ioctl
+ *   DESCRIPTION:	Carries out getdents and fstat on an open directory
+ *   INPUTS: 		file - open directory
+ *					cmd  - FIOC_GETDENTS, FIOC_STAT or a stats command
+ *					arg  - file_io_t * for FIOC_GETDENTS, stat_t * for FIOC_STAT,
+ *						   the counter struct for a stats command
+ *   OUTPUTS:		None
+ *   RETURN VALUE: 	Result of the command, -1 for other commands
+ *   SIDE EFFECTS:	FIOC_GETDENTS moves the directory's cursor
+ */
+int32_t dir_ioctl(file_t * file, uint32_t cmd, uint32_t arg){
+	file_io_t * io = (file_io_t *)arg;
+	
+	fs_select(file -> f_private);
+	switch(cmd){
+		case FIOC_GETDENTS:
+			return dir_getdents(file, io -> buf, io -> nbytes);
+		case FIOC_STAT:
+			return fs_stat(&file -> f_dentry, (stat_t *)arg);
+		default:
+			return fs_stats_ioctl(cmd, arg);
+	}
 }
+
+//Operations of an open directory
+const file_operations_t dir_fops = {
+	.open = &dir_open,
+	.read = &dir_read,
+	.write = &dir_write,
+	.close = &dir_close,
+	.seek = NULL,
+	.ioctl = &dir_ioctl
+};
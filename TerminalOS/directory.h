@@ -2,10 +2,28 @@
  * Header for directory driver
  */
  
+#ifndef _DIRECTORY_H
+#define _DIRECTORY_H
+
 #include "lib.h"
 #include "filesystem.h"
 
-int32_t dir_open();
-int32_t dir_read(void* buf, int32_t nbytes);
-int32_t dir_write(const void* buf, int32_t nbytes);
-int32_t dir_close();
+//Directory entry record filled by getdents
+typedef struct dirent{
+	int8_t name[32];		//not null terminated if 32 characters long
+	uint32_t type;
+	uint32_t inode;
+	uint32_t size;			//bytes in a regular file, 0 otherwise
+}__attribute__((packed)) dirent_t;
+
+int32_t dir_open(file_t * file);
+int32_t dir_read(file_t * file, void* buf, int32_t nbytes);
+int32_t dir_getdents(file_t * file, void* buf, int32_t nbytes);
+int32_t dir_write(file_t * file, const void* buf, int32_t nbytes);
+int32_t dir_close(file_t * file);
+int32_t dir_ioctl(file_t * file, uint32_t cmd, uint32_t arg);
+
+//Operations of an open directory
+extern const file_operations_t dir_fops;
+
+#endif /* _DIRECTORY_H */
@@ -0,0 +1,60 @@
+/* elf.h
+ * ELF32 executable format, the parts the program loader uses
+ */
+
+#ifndef _ELF_H
+#define _ELF_H
+
+#include "types.h"
+
+//"\177ELF" read as a little endian word
+#define ELF_MAGIC 0x464C457F
+
+//e_ident bytes after the magic: 32 bit objects, little endian
+#define ELF_CLASS_32 1
+#define ELF_DATA_LSB 1
+
+//e_type of an executable and e_machine of an x86 one
+#define ELF_TYPE_EXEC 2
+#define ELF_MACHINE_386 3
+
+//Program headers a loader will read
+#define ELF_MAX_PHDRS 16
+
+//p_type of a segment to load, and p_flags bits
+#define PT_LOAD 1
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
+
+//File header at the start of the executable
+typedef struct elf32_ehdr{
+	uint8_t e_ident[16];	//magic, class, data encoding, version, padding
+	uint16_t e_type;
+	uint16_t e_machine;
+	uint32_t e_version;
+	uint32_t e_entry;		//virtual address of the first instruction
+	uint32_t e_phoff;		//file offset of the program header table
+	uint32_t e_shoff;
+	uint32_t e_flags;
+	uint16_t e_ehsize;
+	uint16_t e_phentsize;	//size of a program header
+	uint16_t e_phnum;		//program headers in the table
+	uint16_t e_shentsize;
+	uint16_t e_shnum;
+	uint16_t e_shstrndx;
+}elf32_ehdr_t;
+
+//Program header, one segment of the program's memory image
+typedef struct elf32_phdr{
+	uint32_t p_type;
+	uint32_t p_offset;		//file offset of the segment's bytes
+	uint32_t p_vaddr;		//virtual address the segment is loaded at
+	uint32_t p_paddr;
+	uint32_t p_filesz;		//bytes copied from the file
+	uint32_t p_memsz;		//bytes of memory, the ones past p_filesz are zeroed
+	uint32_t p_flags;
+	uint32_t p_align;
+}elf32_phdr_t;
+
+#endif /* _ELF_H */
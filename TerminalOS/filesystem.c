@@ -3,6 +3,13 @@
  */
  
 #include "filesystem.h"
+#include "lz4.h"
+#include "vfs.h"
+#include "rtc.h"
+#include "directory.h"
+#include "elf.h"
+#include "page_alloc.h"
+#include "sys_calls.h"
 
 #define _128MB	0x8000000
 #define _8MB		0x800000
@@ -11,370 +18,1998 @@
 
 /***************************FILE SYSTEM GLOBAL VARIABLES*****************************/
 
-//Address of the start of the file system
-uint32_t fs = 0x0;
+//Mounted images, the first one holds the programs
+fs_volume_t fs_volumes[FS_MAX_VOLUMES];
+uint32_t fs_num_volumes = 0;
+fs_volume_t * fs_boot = NULL;
+
+//Volume the file system functions work on, chosen by the calls coming in
+//from the VFS (system calls run with interrupts off, so it can't change
+//under one)
+fs_volume_t * vol = NULL;
+
+//Pages of running programs, shared by every process running the same
+//executable, the slot replaced when the cache is full, and counters
+program_page_t program_cache[PROGRAM_CACHE_PAGES];
+uint32_t program_cache_next = 0;
+program_cache_stats_t program_cache_stats;
+
+//Files mapped by mmap in any process
+fs_mapped_file_t fs_mapped_files[FS_MAX_MAPPED_FILES];
 
 /***************************PRIVATE FILE SYSTEM FUNCTIONS****************************/
 
 /*
- * num_dir_entries
- *   DESCRIPTION:	Returns the number of directory entries in the file system
- *   INPUTS:		None
- *   OUTPUTS:		None
- *   RETURN VALUE:	Returns the number of directory entries as an integer
+ * inode_v1
+ *   DESCRIPTION:	Finds a v1 inode in the image
+ *   INPUTS:		inode - index of inode
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Address of the inode's block
+ *   SIDE EFFECTS:	None
+ */
+static inode_t * inode_v1(uint32_t inode){
+	return (inode_t *)(vol -> base + ((inode+1) * 4096));
+}
+
+/*
+ * inode_v2
+ *   DESCRIPTION:	Finds a v2 inode in the packed inode blocks after the superblock
+ *   INPUTS:		inode - index of inode
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Address of the inode
+ *   SIDE EFFECTS:	None
+ */
+static inode_v2_t * inode_v2(uint32_t inode){
+	return (inode_v2_t *)(vol -> base + 4096 + (inode * sizeof(inode_v2_t)));
+}
+
+/*
+ * inode_length
+ *   DESCRIPTION:	Reads the length of a file from its inode
+ *   INPUTS:		inode - index of inode (already checked against num_inodes)
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Length of the file in bytes
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t inode_length(uint32_t inode){
+	if (vol -> version == FS_VERSION_2)
+		return inode_v2(inode) -> length;
+	return inode_v1(inode) -> length;
+}
+
+/*
+ * set_inode_length
+ *   DESCRIPTION:	Stores the length of a file in its inode
+ *   INPUTS:		inode  - index of inode
+ *					length - file length in bytes
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Inode changes
+ */
+static void set_inode_length(uint32_t inode, uint32_t length){
+	if (vol -> version == FS_VERSION_2)
+		inode_v2(inode) -> length = length;
+	else
+		inode_v1(inode) -> length = length;
+}
+
+/*
+ * inode_extent
+ *   DESCRIPTION:	Finds one of a v2 inode's extents, in the inode for the first
+ *					FS_INLINE_EXTENTS and in its extent block after that
+ *   INPUTS:		node  - v2 inode
+ *					index - extent number
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Address of the extent, NULL if the extent block is bad
+ *   SIDE EFFECTS:	None
+ */
+static fs_extent_t * inode_extent(inode_v2_t * node, uint32_t index){
+	if (index < FS_INLINE_EXTENTS)
+		return &(node -> extents[index]);
+	
+	if (node -> extent_block >= vol -> mapped_blocks)
+		return NULL;
+	return (fs_extent_t *)(vol -> data + (node -> extent_block * 4096)) + (index - FS_INLINE_EXTENTS);
+}
+
+/*
+ * block_map
+ *   DESCRIPTION:	Maps a block of a file to its data block. Also reports how
+ *					many of the file's blocks from there on follow each other
+ *					in the image, so a caller can handle the whole run after
+ *					one lookup. v2 inodes store those runs as extents, v1
+ *					inodes are scanned for them.
+ *   INPUTS:		inode - index of inode (already checked against num_inodes)
+ *					block - block of the file (byte offset / 4096)
+ *					run   - set to the length of the run starting at block
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Data block index, -1 if the block is past the file's blocks
+ *   SIDE EFFECTS:	None
+ */
+static int32_t block_map(uint32_t inode, uint32_t block, uint32_t * run){
+	uint32_t i;
+	
+	if (vol -> version == FS_VERSION_2)
+	{
+		inode_v2_t * node = inode_v2(inode);
+		uint32_t first = 0;   //file block the current extent starts at
+		
+		if (node -> num_extents > FS_MAX_EXTENTS)
+			return -1;
+		
+		for (i = 0; i < node -> num_extents; i++)
+		{
+			fs_extent_t * extent = inode_extent(node, i);
+			if (extent == NULL)
+				return -1;
+			if (block < first + extent -> count)
+			{
+				*run = first + extent -> count - block;
+				return extent -> start + (block - first);
+			}
+			first += extent -> count;
+		}
+		return -1;
+	}
+	
+	//blocks a write is filling are held before the length covers them
+	inode_t * node = inode_v1(inode);
+	uint32_t num_blocks = (node -> length + 4095) / 4096;
+	if (inode < FS_MAX_INODES && vol -> inode_table[inode].num_blocks > num_blocks)
+		num_blocks = vol -> inode_table[inode].num_blocks;
+	if (num_blocks > FS_MAX_FILE_BLOCKS)
+		num_blocks = FS_MAX_FILE_BLOCKS;
+	if (block >= num_blocks)
+		return -1;
+	
+	for (i = 1; block + i < num_blocks; i++)
+	{
+		if (node -> data_blocks[block + i] != node -> data_blocks[block] + i)
+			break;
+	}
+	*run = i;
+	return node -> data_blocks[block];
+}
+
+/*
+ * dentry_addr
+ *   DESCRIPTION:	Finds a directory entry in the image. v1 entries follow the
+ *					boot block header, v2 entries fill the data blocks of the
+ *					directory inode.
+ *   INPUTS:		index - directory index
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Address of the 64B entry, NULL if the directory is bad
+ *   SIDE EFFECTS:	None
+ */
+static uint8_t * dentry_addr(uint32_t index){
+	if (vol -> version != FS_VERSION_2)
+		return (uint8_t *)(vol -> base + 64 + (FS_DENTRY_SIZE*index));
+	
+	uint32_t run;
+	int32_t block = block_map(vol -> sb -> root_inode, index / FS_DENTRIES_PER_BLOCK, &run);
+	if (block == -1 || block >= vol -> mapped_blocks)
+		return NULL;
+	return (uint8_t *)(vol -> data + (block * 4096) + (FS_DENTRY_SIZE * (index % FS_DENTRIES_PER_BLOCK)));
+}
+
+/*
+ * name_hash
+ *   DESCRIPTION:	Hashes up to the first 32 characters of a file name (FNV-1a)
+ *					into a slot of the name index
+ *   INPUTS:		fname - name of file to hash
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Home slot of the name in name_index
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t name_hash(const uint8_t* fname){
+	uint32_t hash = 2166136261U;
+	int i;
+	for (i = 0; i < 32 && fname[i] != '\0'; i++)
+	{
+		hash ^= fname[i];
+		hash *= 16777619U;
+	}
+	return hash & (FS_NAME_HASH_SIZE - 1);
+}
+
+/*
+ * record_probes
+ *   DESCRIPTION:	Adds the probe length of one name lookup to the lookup counters
+ *   INPUTS:		probes - number of slots looked at
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	lookup_stats is updated
+ */
+static void record_probes(uint32_t probes){
+	vol -> lookup_stats.probes += probes;
+	if (probes > vol -> lookup_stats.max_probe)
+		vol -> lookup_stats.max_probe = probes;
+}
+
+/*
+ * is_subdir
+ *   DESCRIPTION:	Tells whether a directory entry names a subdirectory, which
+ *					keeps its entries in the data of its inode, rather than
+ *					the root directory
+ *   INPUTS:		dentry - directory entry
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	1 for a subdirectory, 0 otherwise
+ *   SIDE EFFECTS:	None
+ */
+static int32_t is_subdir(const dentry_t * dentry){
+	return dentry -> file_type == 1 && dentry -> inode_num != vol -> root_inode &&
+		dentry -> inode_num < vol -> sb -> num_inodes && dentry -> inode_num < FS_MAX_INODES;
+}
+
+/*
+ * root_dentry
+ *   DESCRIPTION:	Fills a directory entry standing for the root directory
+ *   INPUTS:		dentry - dentry_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+static void root_dentry(dentry_t * dentry){
+	memset(dentry, 0, sizeof(dentry_t));
+	dentry -> file_name[0] = '.';
+	dentry -> file_type = 1;
+	dentry -> inode_num = vol -> root_inode;
+}
+
+/*
+ * dcache_slot
+ *   DESCRIPTION:	Hashes a (directory inode, name) pair to a dentry cache slot
+ *   INPUTS:		dir  - inode of the directory
+ *					name - null terminated name of at most 32 characters
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Slot index
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t dcache_slot(uint32_t dir, const uint8_t * name){
+	return (name_hash(name) ^ (dir * 2654435761U)) & (FS_DCACHE_SIZE - 1);
+}
+
+/*
+ * dir_lookup
+ *   DESCRIPTION:	Finds a name in one directory, first in the dentry cache,
+ *					then in the name index (root) or by scanning the entries
+ *					(subdirectory), caching what was found
+ *   INPUTS:		dir    - inode of the directory
+ *					name   - null terminated name of at most 32 characters
+ *					dentry - dentry_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 if the name was found, -1 otherwise
+ *   SIDE EFFECTS:	dcache and dcache_stats change
+ */
+static int32_t dir_lookup(uint32_t dir, const uint8_t * name, dentry_t * dentry){
+	fs_dcache_entry_t * slot = &vol -> dcache[dcache_slot(dir, name)];
+	
+	vol -> dcache_stats.lookups++;
+	if (slot -> valid && slot -> parent == dir && strncmp(slot -> dentry.file_name, (int8_t *)name, 32) == 0)
+	{
+		vol -> dcache_stats.hits++;
+		*dentry = slot -> dentry;
+		return 0;
+	}
+	vol -> dcache_stats.misses++;
+	
+	if (dir == vol -> root_inode)
+	{
+		if (read_dentry_by_name(name, dentry) == -1)
+			return -1;
+	}
+	else
+	{
+		dentry_t parent;
+		int32_t num_entries, i;
+		
+		parent.file_type = 1;
+		parent.inode_num = dir;
+		num_entries = fs_dir_entries(&parent);
+		for (i = 0; i < num_entries; i++)
+		{
+			if (fs_read_dir(&parent, i, dentry) == -1)
+				return -1;
+			if (strncmp(dentry -> file_name, (int8_t *)name, 32) == 0)
+				break;
+		}
+		if (i >= num_entries)
+			return -1;
+	}
+	
+	if (slot -> valid)
+		vol -> dcache_stats.evictions++;
+	slot -> valid = 1;
+	slot -> parent = dir;
+	slot -> dentry = *dentry;
+	return 0;
+}
+
+/*
+ * build_name_index
+ *   DESCRIPTION:	Inserts every directory entry into the name index
+ *					(open addressing, linear probing)
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	name_index is rebuilt
+ */
+static void build_name_index(){
+	int32_t num_dentries = num_dir_entries();
+	int i;
+	
+	memset(vol -> name_index, 0, sizeof(vol -> name_index));
+	
+	for (i = 0; i < num_dentries; i++)
+	{
+		uint8_t * dentry = dentry_addr(i);
+		if (dentry == NULL)
+			break;
+		
+		uint32_t slot = name_hash(dentry);
+		uint32_t probes = 0;
+		while (vol -> name_index[slot] != 0 && probes < FS_NAME_HASH_SIZE)
+		{
+			slot = (slot + 1) & (FS_NAME_HASH_SIZE - 1);
+			probes++;
+		}
+		if (probes == FS_NAME_HASH_SIZE)
+			break;
+		vol -> name_index[slot] = i + 1;
+	}
+}
+
+/*
+ * build_inode_index
+ *   DESCRIPTION:	Records which directory entry refers to each inode
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	inode_index is rebuilt
+ */
+static void build_inode_index(){
+	int32_t num_dentries = num_dir_entries();
+	int i;
+	
+	memset(vol -> inode_index, 0, sizeof(vol -> inode_index));
+	
+	for (i = 0; i < num_dentries; i++)
+	{
+		uint8_t * dentry = dentry_addr(i);
+		if (dentry == NULL)
+			break;
+		
+		uint32_t inode = *((uint32_t *)(dentry + 36));
+		
+		//Keep the first entry if several share an inode
+		if (inode < FS_MAX_INODES && vol -> inode_index[inode] == 0)
+			vol -> inode_index[inode] = i + 1;
+	}
+}
+
+/*
+ * bitmap_blocks
+ *   DESCRIPTION:	Returns the number of data blocks the free block bitmap
+ *					tracks, the image's blocks up to FS_MAX_DATA_BLOCKS
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of blocks, blocks past it are never allocated
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t bitmap_blocks(){
+	if (vol -> num_data_blocks > FS_MAX_DATA_BLOCKS)
+		return FS_MAX_DATA_BLOCKS;
+	return vol -> num_data_blocks;
+}
+
+/*
+ * mark_inode_blocks
+ *   DESCRIPTION:	Marks the data blocks held by an inode as used, including a
+ *					v2 inode's extent block, and counts them in the inode table
+ *   INPUTS:		inode - index of inode
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	inode_table and block_bitmap change
+ */
+static void mark_inode_blocks(uint32_t inode){
+	uint32_t block = 0;
+	uint32_t run, i;
+	int32_t start;
+	
+	while ((start = block_map(inode, block, &run)) != -1)
+	{
+		for (i = 0; i < run; i++)
+		{
+			if (start + i < bitmap_blocks())
+				vol -> block_bitmap[(start + i) / 32] |= 1 << ((start + i) % 32);
+		}
+		block += run;
+	}
+	vol -> inode_table[inode].num_blocks = block;
+	
+	if (vol -> version == FS_VERSION_2 && inode_v2(inode) -> num_extents > FS_INLINE_EXTENTS)
+	{
+		uint32_t extent_block = inode_v2(inode) -> extent_block;
+		if (extent_block < bitmap_blocks())
+			vol -> block_bitmap[extent_block / 32] |= 1 << (extent_block % 32);
+	}
+}
+
+/*
+ * mark_directory
+ *   DESCRIPTION:	Marks the data blocks of a subdirectory and the inodes and
+ *					blocks of everything below it as used. Entries whose inode
+ *					is already used (such as "." and "..") aren't followed, so
+ *					a directory that is linked twice is only walked once.
+ *   INPUTS:		dir   - inode of the subdirectory
+ *					depth - how deep dir is below the root directory
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	inode_table and block_bitmap change
+ */
+static void mark_directory(uint32_t dir, uint32_t depth){
+	dentry_t self, entry;
+	int32_t num_entries, i;
+	
+	mark_inode_blocks(dir);
+	if (depth >= FS_MAX_PATH_DEPTH)
+		return;
+	
+	self.file_type = 1;
+	self.inode_num = dir;
+	num_entries = fs_dir_entries(&self);
+	for (i = 0; i < num_entries; i++)
+	{
+		if (fs_read_dir(&self, i, &entry) == -1)
+			break;
+		if (entry.inode_num >= vol -> sb -> num_inodes || entry.inode_num >= FS_MAX_INODES || vol -> inode_table[entry.inode_num].used)
+			continue;
+		
+		vol -> inode_table[entry.inode_num].used = 1;
+		if (entry.file_type == 2)
+			mark_inode_blocks(entry.inode_num);
+		else if (is_subdir(&entry))
+			mark_directory(entry.inode_num, depth + 1);
+	}
+}
+
+/*
+ * build_inode_table
+ *   DESCRIPTION:	Marks the inodes used by directory entries and the data
+ *					blocks held by regular files and directories (the v2 root
+ *					directory and every subdirectory), leaving everything else
+ *					free for new files and appends
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	inode_table and block_bitmap are rebuilt
+ */
+static void build_inode_table(){
+	int32_t num_dentries = num_dir_entries();
+	uint32_t num_inodes = vol -> sb -> num_inodes;
+	uint32_t i;
+	
+	memset(vol -> inode_table, 0, sizeof(vol -> inode_table));
+	memset(vol -> block_bitmap, 0, sizeof(vol -> block_bitmap));
+	vol -> alloc_hint = 0;
+	
+	//Bits past the end of the image are never handed out, and blocks past
+	//the bitmap aren't tracked at all
+	for (i = bitmap_blocks(); i < FS_MAX_DATA_BLOCKS; i++)
+	{
+		vol -> block_bitmap[i / 32] |= 1 << (i % 32);
+	}
+	
+	//Inodes past the end of the image can't be used either
+	for (i = num_inodes; i < FS_MAX_INODES; i++)
+	{
+		vol -> inode_table[i].used = 1;
+	}
+	
+	//The v2 directory is held in the blocks of its own inode
+	if (vol -> version == FS_VERSION_2 && vol -> sb -> root_inode < num_inodes && vol -> sb -> root_inode < FS_MAX_INODES)
+	{
+		vol -> inode_table[vol -> sb -> root_inode].used = 1;
+		mark_inode_blocks(vol -> sb -> root_inode);
+	}
+	
+	for (i = 0; i < num_dentries; i++)
+	{
+		uint8_t * dentry = dentry_addr(i);
+		if (dentry == NULL)
+			break;
+		
+		dentry_t entry;
+		read_dentry_by_dir_index(i, &entry);
+		if (entry.inode_num >= num_inodes || entry.inode_num >= FS_MAX_INODES || vol -> inode_table[entry.inode_num].used)
+			continue;
+		
+		vol -> inode_table[entry.inode_num].used = 1;
+		
+		//Only regular files and subdirectories own data blocks
+		if (entry.file_type == 2)
+			mark_inode_blocks(entry.inode_num);
+		else if (is_subdir(&entry))
+			mark_directory(entry.inode_num, 1);
+	}
+}
+
+/*
+ * alloc_block
+ *   DESCRIPTION:	Takes a free data block from the bitmap. The goal block is
+ *					taken if it is free so files grow into consecutive blocks,
+ *					otherwise the search goes on from where the last allocation
+ *					stopped.
+ *   INPUTS:		goal - data block to try first
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Index of the data block, -1 if the image is full
+ *   SIDE EFFECTS:	Block is marked used
+ */
+static int32_t alloc_block(uint32_t goal){
+	uint32_t words = (bitmap_blocks() + 31) / 32;
+	uint32_t word = vol -> alloc_hint / 32;
+	uint32_t n;
+	
+	if (goal < bitmap_blocks() && !(vol -> block_bitmap[goal / 32] & (1 << (goal % 32))))
+	{
+		vol -> block_bitmap[goal / 32] |= 1 << (goal % 32);
+		vol -> alloc_hint = goal;
+		return goal;
+	}
+	
+	for (n = 0; n <= words; n++, word++)
+	{
+		if (word >= words)
+			word = 0;
+		
+		//Skip words with no free block
+		if (vol -> block_bitmap[word] == 0xFFFFFFFF)
+			continue;
+		
+		uint32_t bit = 0;
+		while (vol -> block_bitmap[word] & (1 << bit))
+		{
+			bit++;
+		}
+		vol -> block_bitmap[word] |= 1 << bit;
+		vol -> alloc_hint = (word * 32) + bit;
+		return vol -> alloc_hint;
+	}
+	return -1;
+}
+
+/*
+ * free_block
+ *   DESCRIPTION:	Returns a data block to the bitmap and drops it from the
+ *					block cache, so a stale copy never overwrites its next use
+ *   INPUTS:		block - index of the data block
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Block is marked free
+ */
+static void free_block(uint32_t block){
+	if (block < bitmap_blocks())
+	{
+		vol -> block_bitmap[block / 32] &= ~(1 << (block % 32));
+		bcache_discard(&vol -> dev, vol -> data_block + block);
+	}
+}
+
+/*
+ * extent_grow
+ *   DESCRIPTION:	Adds one data block to the end of a v2 inode, lengthening its
+ *					last extent when the next block is free and starting a new
+ *					extent otherwise. The extent block is taken when the inline
+ *					extents run out.
+ *   INPUTS:		node - v2 inode
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the image or the extent list is full
+ *   SIDE EFFECTS:	Inode and free block bitmap change
+ */
+static int32_t extent_grow(inode_v2_t * node){
+	fs_extent_t * last = NULL;
+	uint32_t goal = vol -> alloc_hint;
+	
+	if (node -> num_extents > 0)
+	{
+		last = inode_extent(node, node -> num_extents - 1);
+		if (last == NULL)
+			return -1;
+		goal = last -> start + last -> count;
+	}
+	
+	int32_t block = alloc_block(goal);
+	if (block == -1)
+		return -1;
+	
+	if (last != NULL && block == last -> start + last -> count)
+	{
+		last -> count++;
+		return 0;
+	}
+	
+	if (node -> num_extents == FS_MAX_EXTENTS)
+	{
+		free_block(block);
+		return -1;
+	}
+	
+	//first extent past the inode needs the extent block
+	if (node -> num_extents == FS_INLINE_EXTENTS)
+	{
+		int32_t extent_block = alloc_block(vol -> alloc_hint);
+		if (extent_block == -1)
+		{
+			free_block(block);
+			return -1;
+		}
+		node -> extent_block = extent_block;
+		memset((uint8_t *)(vol -> data + (extent_block * 4096)), 0, 4096);
+	}
+	
+	fs_extent_t * extent = inode_extent(node, node -> num_extents);
+	extent -> start = block;
+	extent -> count = 1;
+	node -> num_extents++;
+	return 0;
+}
+
+/*
+ * extent_shrink
+ *   DESCRIPTION:	Frees the last data block of a v2 inode, dropping its last
+ *					extent (and the extent block once unused) when it empties
+ *   INPUTS:		node - v2 inode holding at least one block
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Inode and free block bitmap change
+ */
+static void extent_shrink(inode_v2_t * node){
+	fs_extent_t * last = inode_extent(node, node -> num_extents - 1);
+	if (last == NULL)
+		return;
+	
+	last -> count--;
+	free_block(last -> start + last -> count);
+	
+	if (last -> count == 0)
+	{
+		node -> num_extents--;
+		if (node -> num_extents == FS_INLINE_EXTENTS)
+			free_block(node -> extent_block);
+	}
+}
+
+/*
+ * resize_inode
+ *   DESCRIPTION:	Allocates or frees data blocks so an inode holds exactly
+ *					enough blocks for the given length. Only the blocks past
+ *					the inode's current end are touched.
+ *   INPUTS:		inode  - index of inode of a regular file
+ *					length - new file length in bytes
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the file would be too large or the
+ *					image is full (blocks taken so far are kept)
+ *   SIDE EFFECTS:	inode_table, block_bitmap and the inode's blocks change
+ */
+static int32_t resize_inode(uint32_t inode, uint32_t length){
+	uint32_t needed = (length + 4095) / 4096;
+	
+	if (vol -> version == FS_VERSION_2)
+	{
+		inode_v2_t * node = inode_v2(inode);
+		while (vol -> inode_table[inode].num_blocks < needed)
+		{
+			if (extent_grow(node) == -1)
+				return -1;
+			vol -> inode_table[inode].num_blocks++;
+		}
+		while (vol -> inode_table[inode].num_blocks > needed)
+		{
+			extent_shrink(node);
+			vol -> inode_table[inode].num_blocks--;
+		}
+		return 0;
+	}
+	
+	inode_t * file_inode = inode_v1(inode);
+	
+	if (needed > FS_MAX_FILE_BLOCKS)
+		return -1;
+	
+	while (vol -> inode_table[inode].num_blocks < needed)
+	{
+		uint32_t goal = vol -> alloc_hint;
+		if (vol -> inode_table[inode].num_blocks > 0)
+			goal = file_inode -> data_blocks[vol -> inode_table[inode].num_blocks - 1] + 1;
+		
+		int32_t block = alloc_block(goal);
+		if (block == -1)
+			return -1;
+		file_inode -> data_blocks[vol -> inode_table[inode].num_blocks++] = block;
+	}
+	while (vol -> inode_table[inode].num_blocks > needed)
+	{
+		free_block(file_inode -> data_blocks[--vol -> inode_table[inode].num_blocks]);
+	}
+	return 0;
+}
+
+/*
+ * num_dir_entries
+ *   DESCRIPTION:	Returns the number of directory entries in the file system
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Returns the number of directory entries as an integer
+ *   SIDE EFFECTS:	None
+ */
+int32_t num_dir_entries(){
+	return (int32_t)(vol -> sb -> num_dentries);
+}
+
+/*
+ * read_dentry_by_name
+ *   DESCRIPTION:	Reads a dentry by name. Hashes the file name (fname) and
+ *					probes the name index built by fs_init, comparing fname
+ *					only with the directory entries stored in the probed slots.
+ *					An empty slot ends the probe, so a name that isn't in the
+ *					directory fails just as fast. If a match is found, the
+ *					dentry that was in is filled with the values of the dentry
+ *					with the name that we were looking for and returns 0. If a
+ *					match is not found, it returns -1.
+ *   INPUTS:		const uint8_t * fname  - name of file to find
+ *					dentry_t * 		dentry - empty dentry_t struct to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success and -1 on failure, in which success implies we
+ *					found the dentry we were looking for
+ *   SIDE EFFECTS:	The dentry is updated if a dentry with fname is found,
+ *					lookup_stats is updated
+ */
+int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry){
+	//Check for valid input
+	if ((fname == NULL) || (dentry == NULL))
+		return -1;
+
+	vol -> lookup_stats.lookups++;
+
+	// Probe the name index starting at the name's home slot
+	uint32_t slot = name_hash(fname);
+	uint32_t probes = 0;
+	while (probes < FS_NAME_HASH_SIZE)
+	{
+		probes++;
+		
+		//Empty slot means the name was never inserted
+		if (vol -> name_index[slot] == 0)
+			break;
+		
+		//Check if directory entry file name matches fname
+		uint32_t index = vol -> name_index[slot] - 1;
+		if (strncmp((int8_t *)fname, (int8_t *)dentry_addr(index), 32) == 0)
+		{
+			// Directory Found! Update dentry and return success (0)
+			record_probes(probes);
+			vol -> lookup_stats.hits++;
+			read_dentry_by_dir_index(index, dentry);
+			return 0;
+		}
+		
+		//Collision, try the next slot
+		slot = (slot + 1) & (FS_NAME_HASH_SIZE - 1);
+	}
+	
+	record_probes(probes);
+	vol -> lookup_stats.misses++;
+	return -1;
+}
+
+/*
+ * read_dentry_by_index
+ *   DESCRIPTION:	Fills given dentry_t struct with info from inode at given index.
+ *					The directory entry is found through the inode reverse map
+ *					built by fs_init.
+ *   INPUTS: 		index  - integer index of inode in file system
+ *					dentry - empty dentry_t struct to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	0 on success, -1 on failure 
+ *   SIDE EFFECTS: 	None
+ */
+int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
+
+	//check for null dentry
+	if(dentry == 0x0){
+		return -1;
+	}
+	
+	//check for an inode no directory entry refers to
+	if(index >= FS_MAX_INODES || vol -> inode_index[index] == 0){
+		return -1;
+	}
+	
+	read_dentry_by_dir_index(vol -> inode_index[index] - 1, dentry);
+	return 0;
+}
+
+/*
+ * read_dentry_by_dir_index
+ *   DESCRIPTION:	Reads a dentry based on a given directory index.
+ *   INPUTS: 		index  - integer index of the directory
+ *					dentry - empty dentry_t struct to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	1 on success, -1 on failure 
+ *   SIDE EFFECTS: 	None
+ */
+int32_t read_dentry_by_dir_index (uint32_t index, dentry_t* dentry){
+
+	//check for null dentry
+	if(dentry == 0x0){
+		return -1;
+	}
+	
+	// Get a pointer to the dir entry
+	uint32_t dentries = (uint32_t)dentry_addr(index);
+	if(dentries == 0x0){
+		return -1;
+	}
+	
+	//copy file name character by character
+	int j;
+	for(j=0; j<32; j++){
+		dentry->file_name[j] = *((uint32_t*)(dentries+j));
+	}
+	dentry->file_type = *((int32_t*)(dentries + 32));  //starting address + 32B (file name) 
+	dentry->inode_num = *((int32_t*)(dentries + 36));  //starting address + 32B (file name) + 4B (file type)
+	
+	return 1;  //success
+}
+
+/*
+ * fs_lookup
+ *   DESCRIPTION:	Resolves a '/' separated path from the root directory one
+ *					component at a time through the dentry cache. Empty
+ *					components and "." stay in the same directory, ".." moves
+ *					to the parent through the subdirectory's ".." entry (and
+ *					stays at the root directory).
+ *   INPUTS:		path   - null terminated path, a leading '/' is optional
+ *					dentry - dentry_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 if the path names a file or directory, -1 otherwise
+ *   SIDE EFFECTS:	dcache and dcache_stats change
+ */
+int32_t fs_lookup(const uint8_t * path, dentry_t * dentry){
+	uint8_t name[33];
+	dentry_t cur;
+	uint32_t depth = 0;
+	
+	if (path == NULL || dentry == NULL)
+		return -1;
+	
+	root_dentry(&cur);
+	while (*path != '\0')
+	{
+		if (*path == '/')
+		{
+			path++;
+			continue;
+		}
+		
+		//next component, at most 32 characters
+		uint32_t len = 0;
+		while (path[len] != '\0' && path[len] != '/')
+			len++;
+		if (len > 32 || cur.file_type != 1 || ++depth > FS_MAX_PATH_DEPTH)
+			return -1;
+		memset(name, 0, sizeof(name));
+		memcpy(name, path, len);
+		path += len;
+		
+		if (strncmp((int8_t *)name, ".", 33) == 0)
+			continue;
+		if (strncmp((int8_t *)name, "..", 33) == 0 && !is_subdir(&cur))
+		{
+			root_dentry(&cur);
+			continue;
+		}
+		if (dir_lookup(is_subdir(&cur) ? cur.inode_num : vol -> root_inode, name, &cur) == -1)
+			return -1;
+	}
+	
+	*dentry = cur;
+	return 0;
+}
+
+/*
+ * fs_dir_entries
+ *   DESCRIPTION:	Counts the entries of the root directory or a subdirectory
+ *   INPUTS:		dir - directory entry of the directory
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of entries, -1 if dir isn't a directory
+ *   SIDE EFFECTS:	None
+ */
+int32_t fs_dir_entries(const dentry_t * dir){
+	if (dir == NULL || dir -> file_type != 1)
+		return -1;
+	if (!is_subdir(dir))
+		return num_dir_entries();
+	return inode_length(dir -> inode_num) / FS_DENTRY_SIZE;
+}
+
+/*
+ * fs_read_dir
+ *   DESCRIPTION:	Reads an entry of the root directory or a subdirectory.
+ *					Subdirectory entries are read from the data of its inode
+ *					through the block cache.
+ *   INPUTS:		dir    - directory entry of the directory
+ *					index  - entry to read
+ *					dentry - dentry_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if dir isn't a directory or index is
+ *					past its entries
+ *   SIDE EFFECTS:	None
+ */
+int32_t fs_read_dir(const dentry_t * dir, uint32_t index, dentry_t * dentry){
+	disk_dentry_t entry;
+	
+	if (dir == NULL || dentry == NULL || dir -> file_type != 1)
+		return -1;
+	if (!is_subdir(dir))
+		return (read_dentry_by_dir_index(index, dentry) == -1) ? -1 : 0;
+	
+	if (index >= fs_dir_entries(dir) || read_data(dir -> inode_num, index * FS_DENTRY_SIZE, (uint8_t *)&entry, FS_DENTRY_SIZE) == -1)
+		return -1;
+	memcpy(dentry -> file_name, entry.file_name, 32);
+	dentry -> file_type = entry.file_type;
+	dentry -> inode_num = entry.inode_num;
+	return 0;
+}
+
+/*
+ * copy_data
+ *   DESCRIPTION:	Copies length bytes of a file starting at the given file block and
+ *					offset into that block. Each run of consecutive data blocks is
+ *					found with one block map lookup and read one block at a time
+ *					through the block cache.
+ *   INPUTS:		inode        - index of inode representing the file
+ *					block        - file block to start copying from
+ *					block_offset - byte to start at inside the first block
+ *					buf          - character buffer to fill
+ *					length       - number of bytes to copy (already clipped to the file)
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	Number of bytes copied, -1 on a bad data block index
+ *   SIDE EFFECTS: 	The buffer is filled with characters from file
+ */
+static int32_t copy_data(uint32_t inode, uint32_t block, uint32_t block_offset, uint8_t * buf, uint32_t length){
+	uint32_t num_read = 0;   //number of bytes read
+	uint32_t run = 0;        //blocks left in the current run
+	int32_t cur_data_index = 0;
+	
+	while(num_read < length){
+		//look up the next run once the current one is used up
+		if(run == 0){
+			cur_data_index = block_map(inode, block, &run);
+			if(cur_data_index == -1){
+				return -1;
+			}
+		}
+		
+		//check for bad data block entry
+		if(cur_data_index >= vol -> num_data_blocks){
+			return -1;
+		}
+		
+		uint32_t span = 4096 - block_offset;
+		if(span > length - num_read){
+			span = length - num_read;
+		}
+		
+		if(bcache_copy_from(&vol -> dev, vol -> data_block + cur_data_index, block_offset, buf + num_read, span) == -1){
+			return -1;
+		}
+		num_read += span;
+		block_offset = 0;
+		block++;
+		cur_data_index++;
+		run--;
+	}
+	
+	return num_read;
+}
+
+/*
+ * read_data
+ *   DESCRIPTION:	Reads length bytes starting at offset of the file represented by the given inode.
+ *					The first data block is found directly from offset / 4096.
+ *   INPUTS:		inode  - index of inode representing desired file
+ *					offset - byte to start reading from
+ *					buf    - character buffer to fill
+ *					length - number of bytes to read
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	Number of bytes read, -1 indicating error, 0 indicating end of file read 
+ *   SIDE EFFECTS: 	The buffer is filled with characters from file
+ */
+int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+	uint32_t num_inodes = vol -> sb -> num_inodes;       //number of inodes in system
+	
+	//check for bad inode index
+	if(inode >= num_inodes){
+		return -1;
+	}
+	
+	//check for null buf
+	if(buf == 0x0){
+		return -1;
+	}
+
+	uint32_t num_bytes = inode_length(inode);
+	
+	//offset is past this file
+	if(offset >= num_bytes){
+		return 0;
+	}
+	
+	//stop at the end of the file
+	uint32_t eof = 0;
+	if(length >= num_bytes - offset){
+		length = num_bytes - offset;
+		eof = 1;
+	}
+	
+	int32_t num_read = copy_data(inode, offset / 4096, offset % 4096, buf, length);
+	
+	//made it to the end of the file
+	if(eof && num_read != -1){
+		return 0;
+	}
+	return num_read;
+}
+
+/************************************************************************************/
+
+/*
+ * fs_init
+ *   DESCRIPTION:	Sets up a volume for a plain or a compressed (read only)
+ *					image. The first volume set up holds the programs.
+ *   INPUTS: 		Pointer to start of file sytem
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	The volume, NULL if the image is bad or every volume
+ *					is in use
+ *   SIDE EFFECTS:	Builds the volume's file name and inode indices, inode
+ *					table and free block bitmap, and selects it
+ */
+fs_volume_t * fs_init(uint32_t fs_start){
+	if (fs_num_volumes == FS_MAX_VOLUMES)
+		return NULL;
+	vol = &fs_volumes[fs_num_volumes];
+	memset(vol, 0, sizeof(fs_volume_t));
+	
+	// Compressed images are read through a device that expands their blocks
+	// as the cache misses on them. Their uncompressed start, after the
+	// header, holds the boot block and the metadata used in place.
+	vol -> read_only = 0;
+	if (((lz4_header_t *)fs_start) -> magic == LZ4_IMAGE_MAGIC)
+	{
+		if (lz4disk_init(&vol -> dev, fs_start) == -1)
+		{
+			printf("Bad compressed file system image\n");
+			return NULL;
+		}
+		vol -> read_only = 1;
+		fs_start += BLOCK_SIZE;
+	}
+	
+	// Get the pointer start of file system. (i.e. boot block)
+	vol -> base = fs_start;
+	vol -> sb = (superblock_t *)vol -> base;
+	
+	// v2 images mark the boot block's reserved bytes, v1 images leave them zero
+	vol -> version = 1;
+	if (vol -> sb -> magic == FS_MAGIC && vol -> sb -> version == FS_VERSION_2)
+		vol -> version = FS_VERSION_2;
+	
+	// The directory has to fit in the boot block (v1) or the directory
+	// blocks and name index (v2)
+	if (vol -> sb -> num_dentries > (vol -> version == FS_VERSION_2 ? FS_MAX_DENTRIES_V2 : FS_MAX_DENTRIES))
+	{
+		printf("File system image has too many directory entries\n");
+		return NULL;
+	}
+	
+	// Data blocks follow the boot block and the inodes
+	if (vol -> version == FS_VERSION_2)
+		vol -> data_block = vol -> sb -> inode_blocks + 1;
+	else
+		vol -> data_block = vol -> sb -> num_inodes + 1;
+	vol -> data = vol -> base + (vol -> data_block * 4096);
+	vol -> num_data_blocks = vol -> sb -> num_data_blocks;
+	
+	// File data is read through the block cache from a ramdisk over the image,
+	// the boot block, inodes, directory and extent blocks stay in place
+	if (vol -> read_only)
+	{
+		uint32_t raw_blocks = ((lz4_header_t *)vol -> dev.base) -> raw_blocks;
+		if (raw_blocks < vol -> data_block || vol -> data_block + vol -> num_data_blocks > vol -> dev.num_blocks)
+		{
+			printf("Compressed file system image doesn't match its superblock\n");
+			return NULL;
+		}
+		vol -> mapped_blocks = raw_blocks - vol -> data_block;
+	}
+	else
+	{
+		ramdisk_init(&vol -> dev, vol -> base, vol -> data_block + vol -> num_data_blocks);
+		vol -> mapped_blocks = vol -> num_data_blocks;
+	}
+	
+	// Index the file names and inodes so lookups don't scan the directory
+	build_name_index();
+	build_inode_index();
+	
+	// Paths are walked from the root directory's inode
+	dentry_t dot;
+	vol -> root_inode = vol -> sb -> root_inode;
+	if (vol -> version != FS_VERSION_2)
+	{
+		vol -> root_inode = FS_MAX_INODES;
+		if (read_dentry_by_name((uint8_t *)".", &dot) == 0 && dot.file_type == 1)
+			vol -> root_inode = dot.inode_num;
+	}
+	memset(vol -> dcache, 0, sizeof(vol -> dcache));
+	memset(&vol -> dcache_stats, 0, sizeof(vol -> dcache_stats));
+	
+	// Find the free inodes and data blocks
+	build_inode_table();
+	memset(&vol -> lookup_stats, 0, sizeof(vol -> lookup_stats));
+	memset(&vol -> readahead_stats, 0, sizeof(vol -> readahead_stats));
+	
+	fs_num_volumes++;
+	if (fs_boot == NULL)
+		fs_boot = vol;
+	return vol;
+}
+
+/*
+ * fs_mount
+ *   DESCRIPTION:	Sets up a volume for an image and mounts it in the VFS
+ *   INPUTS: 		fs_start - pointer to start of file sytem
+ *					name     - mount name, "" for the volume holding every
+ *							   path that isn't under another mount
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	0 on success, -1 if the image is bad or the name can't
+ *					be mounted
+ *   SIDE EFFECTS:	A volume is taken
+ */
+int32_t fs_mount(uint32_t fs_start, const int8_t * name){
+	fs_volume_t * volume = fs_init(fs_start);
+	
+	if (volume == NULL)
+		return -1;
+	if (vfs_mount(name, &fs_vfs_ops, volume) == -1)
+	{
+		//give the volume back
+		fs_num_volumes--;
+		if (fs_boot == volume)
+			fs_boot = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * fs_select
+ *   DESCRIPTION:	Selects the volume the file system functions work on,
+ *					for drivers that call them with an open file's volume
+ *   INPUTS: 		volume - volume (the f_private of files opened on it)
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None
  *   SIDE EFFECTS:	None
  */
-int32_t num_dir_entries(){
-	return (int32_t)*((uint32_t *)fs);
+void fs_select(fs_volume_t * volume){
+	if (volume != NULL)
+		vol = volume;
 }
 
 /*
- * read_dentry_by_name
- *   DESCRIPTION:	Reads a dentry by name. Essentially goes through
- *					the directory comparing the file name (fname) that
- *					was passed in with the name of the files in the directory.
- *					If a match is found, the dentry that was in is filled with
- *					the values of the dentry with the name that we were looking
- *					for and returns 0. If a match is not found, it returns -1.
- *   INPUTS:		const uint8_t * fname  - name of file to find
- *					dentry_t * 		dentry - empty dentry_t struct to fill
- *   OUTPUTS:		None
- *   RETURN VALUE:	0 on success and -1 on failure, in which success implies we
- *					found the dentry we were looking for
- *   SIDE EFFECTS:	The dentry is updated if a dentry with fname is found
+ * readahead
+ *   DESCRIPTION:	Sizes a file's readahead window from how it is being read and
+ *					queues the blocks after the read for the block cache. The
+ *					window doubles each time a read continues where the last one
+ *					stopped and halves when it doesn't.
+ *   INPUTS: 		file   - open regular file, cursor at the start of the read
+ *					length - bytes about to be read (at least 1)
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	None
+ *   SIDE EFFECTS: 	file's readahead state and readahead_stats change, blocks
+ *					are queued for prefetch
  */
-int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry){
-	//Check for valid input
-	if ((fname == NULL) || (dentry == NULL))
+static void readahead(file_t * file, uint32_t length){
+	uint32_t last = (file -> f_pos + length - 1) / 4096;
+	uint32_t num_blocks = (file -> f_length + 4095) / 4096;
+	
+	if(file -> f_pos == file -> f_ra_pos){
+		vol -> readahead_stats.sequential++;
+		file -> f_ra_window *= 2;
+		if(file -> f_ra_window < FS_RA_MIN_WINDOW){
+			file -> f_ra_window = FS_RA_MIN_WINDOW;
+		}
+		if(file -> f_ra_window > FS_RA_MAX_WINDOW){
+			file -> f_ra_window = FS_RA_MAX_WINDOW;
+		}
+	}
+	else{
+		//what was queued for the old position is no use here
+		vol -> readahead_stats.random++;
+		file -> f_ra_window /= 2;
+		file -> f_ra_end = last + 1;
+	}
+	file -> f_ra_pos = file -> f_pos + length;
+	
+	vol -> readahead_stats.window = file -> f_ra_window;
+	if(file -> f_ra_window > vol -> readahead_stats.max_window){
+		vol -> readahead_stats.max_window = file -> f_ra_window;
+	}
+	
+	//top the queue up to a window past the last block read
+	uint32_t block = file -> f_ra_end;
+	if(block <= last){
+		block = last + 1;
+	}
+	uint32_t end = last + 1 + file -> f_ra_window;
+	if(end > num_blocks){
+		end = num_blocks;
+	}
+	uint32_t run = 0;
+	int32_t data_index = 0;
+	for(; block < end; block++, data_index++, run--){
+		if(run == 0){
+			data_index = block_map(file -> f_dentry.inode_num, block, &run);
+			if(data_index == -1){
+				break;
+			}
+		}
+		if(data_index >= vol -> num_data_blocks || bcache_prefetch(&vol -> dev, vol -> data_block + data_index) == -1){
+			break;
+		}
+	}
+	if(block > file -> f_ra_end){
+		file -> f_ra_end = block;
+	}
+}
+
+/*
+ * fs_open
+ *   DESCRIPTION: 	Caches the state a regular file's reads need in its
+ *					file_t so they don't re-derive it from the image:
+ *					the file length and a block cursor at the start of
+ *					the file.
+ *   INPUTS: 		file - file_t whose f_dentry has been filled
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	0 on success, -1 if the inode is bad
+ *   SIDE EFFECTS: 	file's cached state is set
+ */
+int32_t fs_open(file_t * file){
+	if(file == NULL || file -> f_private == NULL){
+		return -1;
+	}
+	fs_select(file -> f_private);
+	if(file -> f_dentry.inode_num >= vol -> sb -> num_inodes){
+		return -1;
+	}
+	
+	file -> f_length = inode_length(file -> f_dentry.inode_num);
+	file -> f_pos = 0;
+	file -> f_block = 0;
+	file -> f_block_off = 0;
+	file -> f_ra_pos = 0;
+	file -> f_ra_window = FS_RA_MIN_WINDOW;
+	file -> f_ra_end = 0;
+	file -> eof = (file -> f_length == 0);
+	return 0;
+}
+
+/*
+ * fs_read_file
+ *   DESCRIPTION:	Reads up to nbytes of an open regular file, continuing from
+ *					where the last read stopped using the cursor cached by fs_open.
+ *					Blocks past the read are prefetched when the file is read
+ *					sequentially.
+ *   INPUTS:		file   - open regular file
+ *					buf    - buffer to fill
+ *					nbytes - max number of bytes to put into buf
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	Number of bytes read, 0 at end of file, -1 on error
+ *   SIDE EFFECTS: 	The buffer is filled with the file data, the cursor moves
+ */
+int32_t fs_read_file(file_t * file, void * buf, int32_t nbytes){
+	if(file == NULL || buf == NULL || nbytes < 0){
+		return -1;
+	}
+	fs_select(file -> f_private);
+	
+	//pick up writes made through other file descriptors
+	file -> f_length = inode_length(file -> f_dentry.inode_num);
+	
+	//already at end of file
+	if(file -> f_pos >= file -> f_length){
+		file -> eof = 1;
+		return 0;
+	}
+	
+	uint32_t length = nbytes;
+	if(length > file -> f_length - file -> f_pos){
+		length = file -> f_length - file -> f_pos;
+	}
+	if(length == 0){
+		return 0;
+	}
+	
+	readahead(file, length);
+	
+	int32_t num_read = copy_data(file -> f_dentry.inode_num, file -> f_block, file -> f_block_off, buf, length);
+	if(num_read == -1){
 		return -1;
+	}
+	
+	//move the cursor past what was read
+	file -> f_pos += num_read;
+	file -> f_block += (file -> f_block_off + num_read) / 4096;
+	file -> f_block_off = (file -> f_block_off + num_read) % 4096;
+	if(file -> f_pos >= file -> f_length){
+		file -> eof = 1;
+	}
+	
+	return num_read;
+}
 
-	//Return value (initially not found)
-	int32_t retval = -1;
+/*
+ * fs_read
+ *	DESCRIPTION:	Reads up to len bytes of the file with the given inode, starting
+ *					at offset, straight into dest
+ *  INPUTS:			inode  - index of inode representing the file
+ *					offset - byte to start reading from
+ *					dest   - buffer to fill
+ *					len    - max number of bytes to put into dest
+ *	OUTPUTS: 		None
+ *	RETURN VALUE: 	Number of bytes read, 0 at or past end of file, -1 on error
+ *	SIDE EFFECTS: 	dest is filled with the file data 
+ */
+int32_t fs_read(uint32_t inode, uint32_t offset, uint8_t * dest, uint32_t len){
 
-	// Get number of directory entries (First 4B of Boot Block)
-	uint32_t num_dentries = *((uint32_t *)fs);
+	//Check for a valid inode and dest
+	if (inode >= vol -> sb -> num_inodes || dest == NULL)
+		return -1;
+	
+	uint32_t length = inode_length(inode);
+	
+	//Nothing left to read
+	if (offset >= length)
+		return 0;
+	
+	if (len > length - offset)
+		len = length - offset;
 	
-	// Get a pointer to the start of the directory entries (starting at 64B in the Boot Block)
-	uint32_t dentries = fs + 64;
+	return copy_data(inode, offset / 4096, offset % 4096, dest, len);
+}
 
-	// Loop through directory entries and check if fname matches the directory name
-	int i;
-	for (i = 0; i < num_dentries; i++)
+/*
+ * file_size
+ * FUNCTION:		Calculates the size of a file.
+ * INPUT:			uint32_t inode - Index that locates
+ *									 the file we're looking
+ *									 for.
+ * OUTPUT: 			None
+ * RETURN VALUE:	Returns the size of the file in bytes, 0 for a bad inode
+ * SIDE EFFECTS:	None
+ */
+uint32_t file_size(uint32_t inode)
+{
+	if (inode >= vol -> sb -> num_inodes)
+		return 0;
+	
+	return inode_length(inode);
+}
+
+/*
+ * fs_stat
+ *	DESCRIPTION:	Fills a stat_t from a directory entry and its inode
+ *					without touching the file's data
+ *  INPUTS:			dentry - directory entry of the file
+ *					buf    - stat_t to fill
+ *	OUTPUTS: 		None
+ *	RETURN VALUE: 	0 on success, -1 on failure
+ *	SIDE EFFECTS: 	buf is filled
+ */
+int32_t fs_stat(const dentry_t * dentry, stat_t * buf){
+	if (dentry == NULL || buf == NULL)
+		return -1;
+	
+	buf -> type = dentry -> file_type;
+	buf -> inode = dentry -> inode_num;
+	buf -> size = 0;
+	buf -> blocks = 0;
+	
+	//only regular files have data behind their inode
+	if (dentry -> file_type == 2)
 	{
-		//Check if directory entry file name matches fname
-		//   dentries points to the filename of that directory entry
-		if (strncmp((int8_t *)fname, (int8_t *)dentries, 32) == 0)
+		buf -> size = file_size(dentry -> inode_num);
+		buf -> blocks = (buf -> size + 4095) / 4096;
+	}
+	return 0;
+}
+
+/*
+ * fs_seek
+ *	DESCRIPTION:	Moves the read position of an open regular file and
+ *					the block cursor cached with it
+ *  INPUTS:			file   - open regular file
+ *					offset - new read position in bytes
+ *	OUTPUTS: 		None
+ *	RETURN VALUE: 	New position on success, -1 on failure
+ *	SIDE EFFECTS: 	file's cursor and cached length are updated
+ */
+int32_t fs_seek(file_t * file, uint32_t offset){
+	if (file == NULL)
+		return -1;
+	fs_select(file -> f_private);
+	
+	//another descriptor may have changed the file's length
+	file -> f_length = inode_length(file -> f_dentry.inode_num);
+	file -> f_pos = offset;
+	file -> f_block = offset / 4096;
+	file -> f_block_off = offset % 4096;
+	file -> eof = (offset >= file -> f_length);
+	return offset;
+}
+
+/*
+ * fs_block_address
+ *	DESCRIPTION:	Finds where a data block of an open regular file is in memory,
+ *					writing back dirty cached blocks first
+ *  INPUTS:			file  - open regular file
+ *					block - index of the block in the file (byte offset / 4096)
+ *	OUTPUTS: 		None
+ *	RETURN VALUE: 	Address of the data block, 0 if the block is past the end
+ *					of the file, its index is bad or it is compressed
+ *	SIDE EFFECTS: 	None
+ */
+uint32_t fs_block_address(file_t * file, uint32_t block){
+	uint32_t run;
+	
+	if (file == NULL || block >= (inode_length(file -> f_dentry.inode_num) + 4095) / 4096)
+		return 0;
+	
+	int32_t data_index = block_map(file -> f_dentry.inode_num, block, &run);
+	if (data_index == -1 || data_index >= vol -> mapped_blocks)
+		return 0;
+	
+	//the image in memory must hold what was written through the cache
+	if (bcache_sync(&vol -> dev) == -1)
+		return 0;
+	
+	return vol -> data + (data_index * 4096);
+}
+
+/*
+ * fs_map_file
+ *   DESCRIPTION:	Counts a new mapping of an open regular file
+ *   INPUTS: 		file - open regular file being mapped
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	The file's entry in the mapped file table, NULL if
+ *					the table is full
+ *   SIDE EFFECTS: 	None
+ */
+fs_mapped_file_t * fs_map_file(file_t * file){
+	fs_mapped_file_t * free = NULL;
+	uint32_t i;
+	
+	for (i = 0; i < FS_MAX_MAPPED_FILES; i++)
+	{
+		fs_mapped_file_t * mapped = &fs_mapped_files[i];
+		if (mapped -> count == 0)
 		{
-			// Directory Found! Update dentry and return success (0)
-			//    Update dentry file name
-			int j;
-			for(j = 0; j <32; j++)
-			{
-				dentry->file_name[j] = *((uint32_t *)(dentries + j));
-			}
-			
-			//    Update dentry file type
-			dentry->file_type = *((uint32_t *)(dentries + 32));
-			
-			//    Update dentry index node number
-			dentry->inode_num = *((uint32_t *)(dentries + 36));
-			
-			retval = 0;
-			break;
+			if (free == NULL)
+				free = mapped;
+			continue;
 		}
-		else
+		if (mapped -> volume == file -> f_private && mapped -> inode == file -> f_dentry.inode_num)
 		{
-			// Not this directory continue looking (64B later is the next dentry)
-			dentries += 64;
+			mapped -> count++;
+			return mapped;
 		}
 	}
+	if (free == NULL)
+		return NULL;
 	
-	return retval;
+	free -> volume = file -> f_private;
+	free -> inode = file -> f_dentry.inode_num;
+	free -> count = 1;
+	return free;
 }
 
 /*
- * read_dentry_by_index
- *   DESCRIPTION:	Fills given dentry_t struct with info from inode at given index
- *   INPUTS: 		index  - integer index of inode in file system
- *					dentry - empty dentry_t struct to fill
+ * fs_map_ref
+ *   DESCRIPTION:	Counts a copy of a mapping a forked process gets
+ *   INPUTS: 		mapped - entry of the mapped file
  *   OUTPUTS: 		None
- *   RETURN VALUE: 	0 on success, -1 on failure 
+ *   RETURN VALUE: 	None
  *   SIDE EFFECTS: 	None
  */
-int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
+void fs_map_ref(fs_mapped_file_t * mapped){
+	mapped -> count++;
+}
 
-	//check for null dentry
-	if(dentry == 0x0){
+/*
+ * fs_map_release
+ *   DESCRIPTION:	Drops a mapping of a file, the file can shrink again
+ *					once the last one is gone
+ *   INPUTS: 		mapped - entry of the mapped file
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	None
+ *   SIDE EFFECTS: 	None
+ */
+void fs_map_release(fs_mapped_file_t * mapped){
+	if (mapped -> count > 0)
+		mapped -> count--;
+}
+
+/*
+ * is_mapped
+ *   DESCRIPTION:	Checks if a file of the selected volume is mapped
+ *   INPUTS: 		inode - inode of the file
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	1 if a process has it mapped, 0 otherwise
+ *   SIDE EFFECTS: 	None
+ */
+static int32_t is_mapped(uint32_t inode){
+	uint32_t i;
+	
+	for (i = 0; i < FS_MAX_MAPPED_FILES; i++)
+	{
+		if (fs_mapped_files[i].count != 0 && fs_mapped_files[i].volume == vol && fs_mapped_files[i].inode == inode)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * program_cache_drop
+ *   DESCRIPTION:	Drops the cached pages of an executable that changed.
+ *					Processes already running it keep the pages they have.
+ *   INPUTS: 		inode - inode of the file on the boot volume
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	None
+ *   SIDE EFFECTS: 	The cache's references to the frames are dropped
+ */
+static void program_cache_drop(uint32_t inode){
+	uint32_t i;
+	
+	for (i = 0; i < PROGRAM_CACHE_PAGES; i++)
+	{
+		if (program_cache[i].frame != 0 && program_cache[i].inode == inode)
+		{
+			page_unref(program_cache[i].frame);
+			program_cache[i].frame = 0;
+			program_cache_stats.invalidations++;
+		}
+	}
+}
+
+/*
+ * fs_write_file
+ *   DESCRIPTION:	Writes nbytes into an open regular file at its current position,
+ *					overwriting what is there and growing the file past its end.
+ *					New data blocks are taken from the free block bitmap and added
+ *					to the end of the inode's block list one slot at a time.
+ *   INPUTS: 		file   - open regular file
+ *					buf    - bytes to write
+ *					nbytes - number of bytes to write
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	Number of bytes written (less than nbytes if the image fills up),
+ *					-1 on failure or if a process is running the file
+ *   SIDE EFFECTS:	File data, inode and free block bitmap change, the cursor moves
+ */
+int32_t fs_write_file(file_t * file, const void * buf, int32_t nbytes){
+	if(file == NULL || buf == NULL || nbytes < 0){
+		return -1;
+	}
+	fs_select(file -> f_private);
+	if(vol -> read_only){
 		return -1;
 	}
 	
-	// Get number of directory entries (First 4B of Boot Block)
-	uint32_t num_dentries = *((uint32_t *)fs);
+	uint32_t inode = file -> f_dentry.inode_num;
+	uint32_t end = file -> f_pos + nbytes;
 	
-	// Get a pointer to the start of the directory entries (starting at 64B in the Boot Block)
-	uint32_t dentries = fs + 64;
-
-	// Loop through directory entries and check if fname matches the directory name
-	int i;
-	for (i = 0; i < num_dentries; i++){
-		if(*((int32_t *)(dentries+36)) == index){  //found dentry match based on inode num
-			int j;
-			//copy file name character by character
-			for(j=0; j<32; j++){
-				dentry->file_name[j] = *((uint32_t*)(dentries+j));
+	//a running program still reads its pages from the file, programs
+	//started from now on read the new contents
+	if(vol == fs_boot){
+		if(program_running(inode)){
+			return -1;
+		}
+		program_cache_drop(inode);
+	}
+	
+	//a seek past the end leaves a hole that reads back as zeros
+	if(file -> f_pos > inode_length(inode) && fs_truncate(file, file -> f_pos) == -1){
+		return -1;
+	}
+	
+	//take the blocks the write needs, keeping what fit if the image is full
+	if(end > inode_length(inode) && resize_inode(inode, end) == -1){
+		if(vol -> inode_table[inode].num_blocks * 4096 <= file -> f_pos){
+			resize_inode(inode, inode_length(inode));
+			return -1;
+		}
+		end = vol -> inode_table[inode].num_blocks * 4096;
+	}
+	
+	uint32_t num_written = 0;
+	uint32_t length = end - file -> f_pos;
+	uint32_t run = 0;
+	int32_t block = 0;
+	while(num_written < length){
+		uint32_t span = 4096 - file -> f_block_off;
+		if(span > length - num_written){
+			span = length - num_written;
+		}
+		
+		//look up the next run once the current one is used up
+		if(run == 0){
+			block = block_map(inode, file -> f_block, &run);
+			if(block == -1){
+				break;
 			}
-			dentry->file_type = *((int32_t*)(dentries + 32));  //starting address + 32B (file name) 
-			dentry->inode_num = *((int32_t*)(dentries + 36));  //starting address + 32B (file name) + 4B (file type)
-			return 0;
 		}
-		dentries += 64;   //next dentry
+		if(bcache_copy_to(&vol -> dev, vol -> data_block + block, file -> f_block_off, (const uint8_t *)buf + num_written, span) == -1){
+			break;
+		}
+		num_written += span;
+		
+		//move the cursor past what was written
+		file -> f_block_off += span;
+		if(file -> f_block_off == 4096){
+			file -> f_block++;
+			file -> f_block_off = 0;
+			block++;
+			run--;
+		}
 	}
-	return -1;
+	file -> f_pos += num_written;
+	
+	if(file -> f_pos > inode_length(inode)){
+		set_inode_length(inode, file -> f_pos);
+	}
+	file -> f_length = inode_length(inode);
+	file -> eof = (file -> f_pos >= file -> f_length);
+	
+	//mappings point at the image, not at the cache
+	if(is_mapped(inode)){
+		bcache_sync(&vol -> dev);
+	}
+	
+	return num_written;
 }
 
 /*
- * read_dentry_by_dir_index
- *   DESCRIPTION:	Reads a dentry based on a given directory index.
- *   INPUTS: 		index  - integer index of the directory
- *					dentry - empty dentry_t struct to fill
+ * fs_truncate
+ *   DESCRIPTION:	Sets the length of an open regular file. Blocks past the new
+ *					end are freed, growing the file fills the new bytes with zeros.
+ *   INPUTS: 		file   - open regular file
+ *					length - new length in bytes
  *   OUTPUTS: 		None
- *   RETURN VALUE: 	1 on success, -1 on failure 
- *   SIDE EFFECTS: 	None
+ *   RETURN VALUE:	0 on success, -1 on failure, if a mapped file would shrink
+ *					or if a process is running the file
+ *   SIDE EFFECTS:	Inode and free block bitmap change
  */
-int32_t read_dentry_by_dir_index (uint32_t index, dentry_t* dentry){
-
-	//check for null dentry
-	if(dentry == 0x0){
+int32_t fs_truncate(file_t * file, uint32_t length){
+	if(vol -> read_only || file == NULL){
 		return -1;
 	}
 	
-	// Get a pointer to the dir entry
-	uint32_t dentries = fs + 64 + (64*index);
+	uint32_t inode = file -> f_dentry.inode_num;
+	uint32_t old_length = inode_length(inode);
 	
-	//copy file name character by character
-	int j;
-	for(j=0; j<32; j++){
-		dentry->file_name[j] = *((uint32_t*)(dentries+j));
+	//freed blocks could be reused while a mapping still shows them
+	if(length < old_length && is_mapped(inode)){
+		return -1;
 	}
-	dentry->file_type = *((int32_t*)(dentries + 32));  //starting address + 32B (file name) 
-	dentry->inode_num = *((int32_t*)(dentries + 36));  //starting address + 32B (file name) + 4B (file type)
 	
-	return 1;  //success
+	if(vol == fs_boot){
+		if(program_running(inode)){
+			return -1;
+		}
+		program_cache_drop(inode);
+	}
+	if(resize_inode(inode, length) == -1){
+		resize_inode(inode, old_length);
+		return -1;
+	}
+	
+	//zero from the old end (or the start of a reused block) to the new end
+	uint32_t pos = old_length;
+	while(pos < length){
+		uint32_t span = 4096 - (pos % 4096);
+		if(span > length - pos){
+			span = length - pos;
+		}
+		uint32_t run;
+		int32_t block = block_map(inode, pos / 4096, &run);
+		if(block != -1){
+			bcache_zero(&vol -> dev, vol -> data_block + block, pos % 4096, span);
+		}
+		pos += span;
+	}
+	
+	set_inode_length(inode, length);
+	file -> f_length = length;
+	file -> eof = (file -> f_pos >= length);
+	return 0;
 }
 
 /*
- * read_data
- *   DESCRIPTION:	Reads length bytes starting at offset of the file represented by the given inode
- *   INPUTS:		inode  - index of inode representing desired file
- *					offset - byte to start reading from
- *					buf    - character buffer to fill
- *					length - number of bytes to read
+ * fs_create
+ *   DESCRIPTION:	Creates an empty regular file: takes a free inode, adds a
+ *					directory entry for it (to the boot block in v1, to the end
+ *					of the directory inode in v2, which takes another block
+ *					when its last one is full) and puts the name in the name
+ *					and inode indices
+ *   INPUTS: 		fname - name of the new file (at most 32 characters)
  *   OUTPUTS: 		None
- *   RETURN VALUE: 	Number of bytes read, -1 indicating error, 0 indicating end of file read 
- *   SIDE EFFECTS: 	The buffer is filled with characters from file
- */
-int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
-	//check for bad inode index
-	if(inode < 0 || inode > 63){
+ *   RETURN VALUE:	0 on success, -1 if the name is bad or taken, the
+ *					directory, inodes or image are full, or the image is read only
+ *   SIDE EFFECTS:	Directory, inode table and indices change
+ */
+int32_t fs_create(const uint8_t * fname){
+	dentry_t entry;
+	uint32_t num_inodes = vol -> sb -> num_inodes;
+	uint32_t num_dentries = vol -> sb -> num_dentries;
+	
+	if(vol -> read_only || fname == NULL){
 		return -1;
 	}
 	
-	//check for null buf
-	if(buf == 0x0){
+	//bad or taken name
+	uint32_t name_len = strlen((int8_t *)fname);
+	if(name_len == 0 || name_len > 32 || read_dentry_by_name(fname, &entry) == 0){
 		return -1;
 	}
-
-	uint32_t num_read = 0;   //number of bytes read
-	int i = 0;               //current data block counter
-	uint32_t num_inodes = *((uint32_t *)(fs + 4));       //number of inodes in system
-	uint32_t num_data_blocks = *((uint32_t *)(fs + 8));  //number of data blocks in system
-	uint32_t inode_addrs = fs + ((inode+1) * 4096);      //start of given inode 
-	uint32_t data_addrs = fs + ((num_inodes+1) * 4096);  //start of data blocks
-	uint32_t d = inode_addrs + 4; 						 //address of current data block
-	uint32_t num_bytes = *((uint32_t *)inode_addrs);
-	
-	//visit every data block pointer	
-	while(i <= num_bytes/4096){
-		int j = 0;
-		uint32_t cur_data_index = *((uint32_t *)d);                     //integer index of data block
-		uint32_t cur_data_pointer = data_addrs+(cur_data_index*4096);   //address of data block
-		
-		//check for bad data block entry
-		if(cur_data_index > num_data_blocks){
+	
+	//files are only created in the root directory
+	uint32_t pos;
+	for(pos = 0; pos < name_len; pos++){
+		if(fname[pos] == '/'){
 			return -1;
 		}
-		
-		//check if offset is in this data block
-		if(offset / 4096 == i){
-			//cur_data_pointer += offset;
-			j = offset % 4096;
-		}
-		//offset is past this file
-		else if(offset / 4096 > i){
-			i++;
-			continue;
+	}
+	
+	//directory full
+	if(num_dentries >= (vol -> version == FS_VERSION_2 ? FS_MAX_DENTRIES_V2 : FS_MAX_DENTRIES)){
+		return -1;
+	}
+	
+	//find a free inode
+	if(num_inodes > FS_MAX_INODES){
+		num_inodes = FS_MAX_INODES;
+	}
+	uint32_t inode;
+	for(inode = 0; inode < num_inodes; inode++){
+		if(!vol -> inode_table[inode].used){
+			break;
 		}
-		
-		//current character in file
-		unsigned char cur_char; //= *((uint8_t *)cur_data_pointer);
-		
-		//make sure number of read bytes is less than length
-		while(num_read < length && j < 4096){
-			 //number of bytes read so far
-			//num_read++;
-			cur_char = *((uint8_t *)(cur_data_pointer + j));
-			
-			//write character to buffer
-			buf[(i*4096) + j - offset] = cur_char;
-			j++;
-			num_read++;
-			
-			if((num_read + offset) == num_bytes){
-				return 0;
-			}
-			
-			//find next character
-			//cur_char = *((uint8_t *)(cur_data_pointer + j));
+	}
+	if(inode == num_inodes){
+		return -1;
+	}
+	
+	//a full v2 directory block needs another after it
+	if(vol -> version == FS_VERSION_2 && num_dentries % FS_DENTRIES_PER_BLOCK == 0){
+		uint32_t root = vol -> sb -> root_inode;
+		if(resize_inode(root, (num_dentries + 1) * FS_DENTRY_SIZE) == -1){
+			resize_inode(root, inode_length(root));
+			return -1;
 		}
-
-		i++;
-		
-		//get address to next data block
-		d = inode_addrs + 4 + (i * 4);
+		memset(dentry_addr(num_dentries), 0, 4096);
 	}
 	
-	//made it to the end of the file
-	return num_read;
+	vol -> inode_table[inode].used = 1;
+	vol -> inode_table[inode].num_blocks = 0;
+	if(vol -> version == FS_VERSION_2){
+		memset(inode_v2(inode), 0, sizeof(inode_v2_t));
+		set_inode_length(vol -> sb -> root_inode, (num_dentries + 1) * FS_DENTRY_SIZE);
+	}
+	else{
+		set_inode_length(inode, 0);
+	}
+	
+	//fill in the new directory entry
+	uint8_t * dentry = dentry_addr(num_dentries);
+	memset(dentry, 0, FS_DENTRY_SIZE);
+	memcpy(dentry, fname, name_len);
+	*((uint32_t *)(dentry + 32)) = 2;
+	*((uint32_t *)(dentry + 36)) = inode;
+	vol -> sb -> num_dentries = num_dentries + 1;
+	
+	//index the new entry (the index holds more slots than a directory can
+	//have entries, so one is free)
+	uint32_t slot = name_hash(fname);
+	uint32_t probes = 0;
+	while(vol -> name_index[slot] != 0 && probes < FS_NAME_HASH_SIZE){
+		slot = (slot + 1) & (FS_NAME_HASH_SIZE - 1);
+		probes++;
+	}
+	vol -> name_index[slot] = num_dentries + 1;
+	vol -> inode_index[inode] = num_dentries + 1;
+	
+	return 0;
 }
 
 /*
- * file_size
- * FUNCTION:		Calculates the size of a file.
- * INPUT:			uint32_t inode - Index that locates
- *									 the file we're looking
- *									 for.
- * OUTPUT: 			None
- * RETURN VALUE:	Returns the size of the file in bytes
- * SIDE EFFECTS:	None
+ * fs_close
+ *   DESCRIPTION:	Closes an open regular file. Its data is already in the
+ *					block cache, so there is nothing to write back.
+ *   INPUTS:		file - open regular file
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	0
+ *   SIDE EFFECTS:	None
  */
-uint32_t file_size(uint32_t inode)
-{
-	uint32_t inode_addrs = fs + ((inode+1) * 4096);
-	return *((uint32_t *)inode_addrs);
+int32_t fs_close(file_t * file){
+	return 0;
 }
 
-/************************************************************************************/
-
 /*
- * fs_init
- *   DESCRIPTION:	Initialize file sytem global variables
- *   INPUTS: 		Pointer to start of file sytem
+ * fs_lseek
+ *   DESCRIPTION:	Moves the read position of an open regular file
+ *   INPUTS:		file   - open regular file
+ *					offset - byte offset relative to whence
+ *					whence - SEEK_SET, SEEK_CUR or SEEK_END
  *   OUTPUTS: 		None
- *   RETURN VALUE:	None 
- *   SIDE EFFECTS:	None
+ *   RETURN VALUE:	New position, -1 on failure
+ *   SIDE EFFECTS:	file's cursor is moved
  */
-void fs_init(uint32_t fs_start){
-	// Get the pointer start of file system. (i.e. boot block)
-	fs = fs_start;
+int32_t fs_lseek(file_t * file, int32_t offset, int32_t whence){
+	int32_t base;
+	
+	if(file == NULL){
+		return -1;
+	}
+	fs_select(file -> f_private);
+	
+	switch(whence){
+		case SEEK_SET:
+			base = 0;
+			break;
+		case SEEK_CUR:
+			base = file -> f_pos;
+			break;
+		case SEEK_END:
+			base = inode_length(file -> f_dentry.inode_num);
+			break;
+		default:
+			return -1;
+	}
+	
+	//can't seek before the start of the file
+	if(base + offset < 0){
+		return -1;
+	}
+	return fs_seek(file, base + offset);
 }
 
 /*
- * fs_open
- *   DESCRIPTION: 	Not used or implemented as file image 
- *					is already loaded.
- *   INPUTS: 		None
+ * fs_ioctl
+ *   DESCRIPTION:	Carries out the file system calls on an open regular file
+ *					that aren't reads, writes or seeks
+ *   INPUTS:		file - open regular file
+ *					cmd  - FIOC_STAT, FIOC_TRUNCATE, FIOC_PREAD, FIOC_MAP_PAGE or a
+ *						   stats command
+ *					arg  - argument of the command
  *   OUTPUTS: 		None
- *   RETURN VALUE: 	-1; shouldn't be called 
- *   SIDE EFFECTS: 	None
+ *   RETURN VALUE:	Result of the command, -1 on failure or for other commands
+ *   SIDE EFFECTS:	Depends on the command
  */
-int32_t fs_open(){
-	//Image already in kernel
-	return -1;
+int32_t fs_ioctl(file_t * file, uint32_t cmd, uint32_t arg){
+	file_io_t * io = (file_io_t *)arg;
+	file_page_t * page = (file_page_t *)arg;
+	
+	fs_select(file -> f_private);
+	switch(cmd){
+		case FIOC_STAT:
+			return fs_stat(&file -> f_dentry, (stat_t *)arg);
+		case FIOC_TRUNCATE:
+			return fs_truncate(file, arg);
+		case FIOC_PREAD:
+			if(io -> nbytes < 0){
+				return -1;
+			}
+			return fs_read(file -> f_dentry.inode_num, io -> offset, (uint8_t *)io -> buf, io -> nbytes);
+		case FIOC_MAP_PAGE:
+			page -> address = fs_block_address(file, page -> page);
+			return (page -> address == 0) ? -1 : 0;
+		default:
+			return fs_stats_ioctl(cmd, arg);
+	}
 }
 
+//Operations of open regular files
+const file_operations_t fs_file_fops = {
+	.open = &fs_open,
+	.read = &fs_read_file,
+	.write = &fs_write_file,
+	.close = &fs_close,
+	.seek = &fs_lseek,
+	.ioctl = &fs_ioctl
+};
+
 /*
- * fs_read
- *	DESCRIPTION:	Read file specified by buf and read nbytes of that file and put into buf
- *  INPUTS:			buf -	initialized with what wants to be read (defined in filesystem.h)
-							that will be overrided with the file data.
-					nbytes - max number of bytes to put into buf
- *	OUTPUTS: 		None
- *	RETURN VALUE: 	Number of bytes read (0 if file not found)
- *	SIDE EFFECTS: 	The buffer is filled with the file data 
+ * fs_vfs_lookup
+ *   DESCRIPTION:	Looks a path up in the image for the VFS and picks the
+ *					driver of the entry's type
+ *   INPUTS:		mnt    - mount of the image
+ *					path   - path inside the image
+ *					dentry - dentry to fill
+ *					fops   - filled with the file operations of the entry
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if there is no such file
+ *   SIDE EFFECTS:	None
  */
-int32_t fs_read(void* buf, int32_t nbytes){
-
-	//Check for a valid buf
-	if (buf == NULL)
-		return 0;
-	
-	dentry_t entry;
+static int32_t fs_vfs_lookup(vfs_mount_t * mnt, const uint8_t * path, dentry_t * dentry, const file_operations_t ** fops){
+	fs_select(mnt -> private);
+	if(fs_lookup(path, dentry) == -1){
+		return -1;
+	}
 	
-	//Check what buf wants to read
-	uint8_t *fname;
-	uint32_t index;
-	uint32_t offset = 0;
-	switch (*((uint32_t *)buf))
-	{
-		case 0: //Read file by name
-			fname = (uint8_t *)(buf + 4);
-			if ( read_dentry_by_name (fname, &entry) )
-			{
-				//File not found!!!
-				return 0;
-			}
+	switch(dentry -> file_type){
+		case 0:
+			*fops = &rtc_fops;
 			break;
-		case 1: //Read file by index
-			index = *((uint32_t *)(buf + 4));
-			offset = *((uint32_t *)(buf + 8));
-			if ( read_dentry_by_index (index, &entry))
-			{
-				//File not found!!!
-				return 0;
-			}
+		case 1:
+			*fops = &dir_fops;
+			break;
+		case 2:
+			*fops = &fs_file_fops;
+			break;
+		default:
+			*fops = NULL;
 			break;
 	}
-	
-	//Read data if buf is big enough for the file
-	uint32_t fsize = *((uint32_t *)(fs + ((entry.inode_num + 1) * 4096))); // get inode num bytes for file
-	
-	int retval = read_data (entry.inode_num, offset, (uint8_t *)buf, nbytes);
-	
-	if ( retval == 0 )
-	{
-		//End of file reached so nbytes read
-		return fsize;
-	}
-
-	return retval;
+	return 0;
 }
 
 /*
- * fs_write
- *   DESCRIPTION:	Does nothing, returns -1 to imply that files can't be written to
- *   INPUTS: 		Pointer to a buffer, max number of bytes to put in the buffer
- *   OUTPUTS: 		None
- *   RETURN VALUE:	-1 (This is a read-Only file system)
- *   SIDE EFFECTS:	None
+ * fs_vfs_create
+ *   DESCRIPTION:	Creates an empty regular file in the image for the VFS
+ *   INPUTS:		mnt  - mount of the image
+ *					path - name of the file
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	See fs_create
  */
-int32_t fs_write(const void* buf, int32_t nbytes){
-	//Read only file system
-	return -1;
+static int32_t fs_vfs_create(vfs_mount_t * mnt, const uint8_t * path){
+	fs_select(mnt -> private);
+	return fs_create(path);
 }
 
 /*
- * fs_close
- *   DESCRIPTION:	Not implemented as you cannot close the only file system.
- *   INPUTS:		None
- *   OUTPUTS: 		None
- *   RETURN VALUE:	-1
+ * fs_vfs_stat
+ *   DESCRIPTION:	Fills a stat_t from a dentry of the image for the VFS
+ *   INPUTS:		mnt    - mount of the image
+ *					dentry - dentry from fs_vfs_lookup
+ *					buf    - stat_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on failure
  *   SIDE EFFECTS:	None
  */
-int32_t fs_close(){
-	//Can't close the only file system
-	return -1;
+static int32_t fs_vfs_stat(vfs_mount_t * mnt, const dentry_t * dentry, stat_t * buf){
+	fs_select(mnt -> private);
+	return fs_stat(dentry, buf);
 }
 
+//Image file system, files can't be removed from it
+const vfs_fs_ops_t fs_vfs_ops = {
+	.lookup = &fs_vfs_lookup,
+	.create = &fs_vfs_create,
+	.unlink = NULL,
+	.stat = &fs_vfs_stat
+};
+
 /*
  * print_dentry
  *   DESCRIPTION:	Prints dentry information to display
@@ -393,9 +2028,145 @@ void print_dentry(dentry_t entry){
 	printf("\ninode: %d\n", entry.inode_num);
 }
 
+/*
+ * fs_get_lookup_stats
+ *   DESCRIPTION:	Copies the name lookup counters
+ *   INPUTS:		stats - fs_lookup_stats_t struct to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	None
+ */
+void fs_get_lookup_stats(fs_lookup_stats_t * stats){
+	if (stats != NULL)
+		*stats = vol -> lookup_stats;
+}
+
+/*
+ * print_lookup_stats
+ *   DESCRIPTION:	Prints the name lookup counters to display
+ *   INPUTS:		None
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	Prints to screen
+ */
+void print_lookup_stats(){
+	printf("\nlookups  : %d", vol -> lookup_stats.lookups);
+	printf("\nhits     : %d", vol -> lookup_stats.hits);
+	printf("\nmisses   : %d", vol -> lookup_stats.misses);
+	printf("\nprobes   : %d", vol -> lookup_stats.probes);
+	printf("\nmax probe: %d\n", vol -> lookup_stats.max_probe);
+}
+
+/*
+ * fs_get_dcache_stats
+ *   DESCRIPTION:	Copies the dentry cache counters
+ *   INPUTS:		stats - fs_dcache_stats_t struct to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	None
+ */
+void fs_get_dcache_stats(fs_dcache_stats_t * stats){
+	if (stats != NULL)
+		*stats = vol -> dcache_stats;
+}
+
+/*
+ * print_dcache_stats
+ *   DESCRIPTION:	Prints the dentry cache counters and hit rate to display
+ *   INPUTS:		None
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	Prints to screen
+ */
+void print_dcache_stats(){
+	printf("\nlookups  : %d", vol -> dcache_stats.lookups);
+	printf("\nhits     : %d", vol -> dcache_stats.hits);
+	printf("\nmisses   : %d", vol -> dcache_stats.misses);
+	printf("\nevictions: %d", vol -> dcache_stats.evictions);
+	if (vol -> dcache_stats.lookups != 0)
+		printf("\nhit rate : %d%%", (vol -> dcache_stats.hits * 100) / vol -> dcache_stats.lookups);
+	printf("\n");
+}
+
+/*
+ * fs_get_readahead_stats
+ *   DESCRIPTION:	Copies the readahead counters
+ *   INPUTS:		stats - fs_readahead_stats_t struct to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	None
+ */
+void fs_get_readahead_stats(fs_readahead_stats_t * stats){
+	if (stats != NULL)
+		*stats = vol -> readahead_stats;
+}
+
+/*
+ * print_readahead_stats
+ *   DESCRIPTION:	Prints the readahead counters and how many prefetched
+ *					blocks were used to display
+ *   INPUTS:		None
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	Prints to screen
+ */
+void print_readahead_stats(){
+	bcache_stats_t cache;
+	bcache_get_stats(&cache);
+	
+	printf("\nsequential : %d", vol -> readahead_stats.sequential);
+	printf("\nrandom     : %d", vol -> readahead_stats.random);
+	printf("\nwindow     : %d", vol -> readahead_stats.window);
+	printf("\nmax window : %d", vol -> readahead_stats.max_window);
+	printf("\nprefetches : %d", cache.prefetches);
+	printf("\nused       : %d", cache.prefetch_hits);
+	if (cache.prefetches != 0)
+		printf("\nhit rate   : %d%%", (cache.prefetch_hits * 100) / cache.prefetches);
+	printf("\n");
+}
+
+/*
+ * fs_stats_ioctl
+ *   DESCRIPTION:	Copies counters out for the stats ioctls of an open file
+ *					or directory of an image
+ *   INPUTS:		cmd - FIOC_READAHEAD_STATS, FIOC_BCACHE_STATS,
+ *						  FIOC_DCACHE_STATS, FIOC_LOOKUP_STATS or
+ *						  FIOC_PROGRAM_CACHE_STATS
+ *					arg - counter struct of the command to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	0 on success, -1 for other commands or a NULL arg
+ *   SIDE EFFECTS: 	None
+ */
+int32_t fs_stats_ioctl(uint32_t cmd, uint32_t arg){
+	if (arg == 0)
+		return -1;
+	
+	switch (cmd)
+	{
+		case FIOC_READAHEAD_STATS:
+			fs_get_readahead_stats((fs_readahead_stats_t *)arg);
+			return 0;
+		case FIOC_BCACHE_STATS:
+			bcache_get_stats((bcache_stats_t *)arg);
+			return 0;
+		case FIOC_DCACHE_STATS:
+			fs_get_dcache_stats((fs_dcache_stats_t *)arg);
+			return 0;
+		case FIOC_LOOKUP_STATS:
+			fs_get_lookup_stats((fs_lookup_stats_t *)arg);
+			return 0;
+		case FIOC_PROGRAM_CACHE_STATS:
+			program_cache_get_stats((program_cache_stats_t *)arg);
+			return 0;
+		default:
+			return -1;
+	}
+}
+
 /*
  * is_valid_cmd
- *  DESCRIPTION:	Checks if given program name is a valid executable
+ *  DESCRIPTION:	Checks if given program name is a valid executable on
+ *					the boot volume, which it selects
  *  INPUTS:			executable 	 - pointer of dentry to fill
 					program_name - name of program to load 
  *  OUTPUTS:		None
@@ -403,15 +2174,19 @@ void print_dentry(dentry_t entry){
  *  SIDE EFFECTS:	Fills executable (argument passed in)
  */
 int32_t is_valid_cmd(dentry_t * executable, const uint8_t* program_name){
-	if (read_dentry_by_name(program_name, executable) == -1)
+	//Programs are only loaded from the boot volume
+	if (fs_boot == NULL)
+		return -1;
+	fs_select(fs_boot);
+	if (fs_lookup(program_name, executable) == -1 || executable -> file_type != 2)
 	{
 		//Not valid file name
 		return -1;
 	}
-	//Check if file is exe (ELF magic number is 0x464C457F)
+	//Check if file is exe
 	uint8_t buf[4];
 	read_data(executable->inode_num, 0, buf, 4);
-	if (*((uint32_t *)buf) != 0x464C457F)
+	if (*((uint32_t *)buf) != ELF_MAGIC)
 	{
 		//Not an executable
 		return -1;
@@ -419,9 +2194,244 @@ int32_t is_valid_cmd(dentry_t * executable, const uint8_t* program_name){
 	return 1;
 }
 
+/*
+ * read_elf_segments
+ *   DESCRIPTION:	Reads the PT_LOAD segments of an ELF executable into a
+ *					pcb. Nothing is copied, the pages of the segments are
+ *					read from the file when the program first touches them.
+ *   INPUTS: 		inode - inode of the executable
+ *					pcb   - pcb of the process to run it
+ *					entry - filled with the entry point
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	0 on success, -1 if the header is bad, a segment isn't
+ *					in the file or doesn't fit in program memory, or there
+ *					are too many segments
+ *   SIDE EFFECTS: 	Fills the pcb's segments on success, a failure leaves
+ *					the pcb as it was so a running program can exec
+ */
+static int32_t read_elf_segments(uint32_t inode, pcb_t * pcb, uint32_t * entry){
+	elf32_ehdr_t ehdr;
+	elf32_phdr_t phdrs[ELF_MAX_PHDRS];
+	program_segment_t segments[PCB_MAX_SEGMENTS];
+	uint32_t num_segments = 0;
+	uint32_t length = file_size(inode);
+	uint32_t i, end;
+	
+	//read_data returns 0 when it reaches the end of the file, so the ranges
+	//read are checked against the file's length instead
+	if (length < sizeof(ehdr) || read_data(inode, 0, (uint8_t *)&ehdr, sizeof(ehdr)) == -1)
+		return -1;
+	if (*((uint32_t *)ehdr.e_ident) != ELF_MAGIC || ehdr.e_ident[4] != ELF_CLASS_32 || ehdr.e_ident[5] != ELF_DATA_LSB
+		|| ehdr.e_type != ELF_TYPE_EXEC || ehdr.e_machine != ELF_MACHINE_386
+		|| ehdr.e_phentsize != sizeof(elf32_phdr_t) || ehdr.e_phnum == 0 || ehdr.e_phnum > ELF_MAX_PHDRS)
+		return -1;
+	
+	uint32_t size = ehdr.e_phnum * sizeof(elf32_phdr_t);
+	if (ehdr.e_phoff > length || size > length - ehdr.e_phoff || read_data(inode, ehdr.e_phoff, (uint8_t *)phdrs, size) == -1)
+		return -1;
+	
+	for (i = 0; i < ehdr.e_phnum; i++)
+	{
+		elf32_phdr_t * ph = &phdrs[i];
+		if (ph -> p_type != PT_LOAD || ph -> p_memsz == 0)
+			continue;
+		
+		//the segment has to be inside the program's 4MB
+		end = ph -> p_vaddr + ph -> p_memsz;
+		if (ph -> p_filesz > ph -> p_memsz || ph -> p_vaddr < _128MB || end > _128MB + _4MB || end < ph -> p_vaddr)
+			return -1;
+		if (ph -> p_offset > length || ph -> p_filesz > length - ph -> p_offset)
+			return -1;
+		if (num_segments == PCB_MAX_SEGMENTS)
+			return -1;
+		
+		program_segment_t * seg = &segments[num_segments++];
+		seg -> vaddr = ph -> p_vaddr;
+		seg -> memsz = ph -> p_memsz;
+		seg -> offset = ph -> p_offset;
+		seg -> filesz = ph -> p_filesz;
+		seg -> writable = (ph -> p_flags & PF_W) != 0;
+	}
+	
+	memcpy(pcb -> segments, segments, sizeof(segments));
+	pcb -> num_segments = num_segments;
+	*entry = ehdr.e_entry;
+	return 0;
+}
+
+/*
+ * program_page_flags
+ *   DESCRIPTION:	Finds which of a program's segments are on a page
+ *   INPUTS: 		pcb  - pcb of the process
+ *					addr - virtual address of the page
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	PROGRAM_PAGE_WRITABLE if a segment on the page is
+ *					writable, with PROGRAM_PAGE_FILE if any has file bytes
+ *					on it, -1 if no segment is on the page
+ *   SIDE EFFECTS: 	None
+ */
+static int32_t program_page_flags(pcb_t * pcb, uint32_t addr){
+	int32_t flags = -1;
+	uint32_t i;
+	
+	for (i = 0; i < pcb -> num_segments; i++)
+	{
+		program_segment_t * seg = &pcb -> segments[i];
+		if (seg -> vaddr >= addr + 4096 || seg -> vaddr + seg -> memsz <= addr)
+			continue;
+		
+		if (flags == -1)
+			flags = 0;
+		if (seg -> writable)
+			flags |= PROGRAM_PAGE_WRITABLE;
+		if (seg -> filesz != 0 && seg -> vaddr + seg -> filesz > addr)
+			flags |= PROGRAM_PAGE_FILE;
+	}
+	return flags;
+}
+
+/*
+ * load_program_page
+ *   DESCRIPTION:	Fills a page of a process's program memory from its
+ *					executable. The file bytes of each segment on the page
+ *					are read from the boot volume and the rest is zeroed.
+ *					This runs from the page fault handler, possibly in the
+ *					middle of another file system call, so the selected
+ *					volume is put back afterwards.
+ *   INPUTS: 		pcb   - pcb of the process
+ *					addr  - virtual address of the page
+ *					frame - kernel address of the frame to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	None
+ *   SIDE EFFECTS: 	None
+ */
+static void load_program_page(pcb_t * pcb, uint32_t addr, uint8_t * frame){
+	fs_volume_t * prev = vol;
+	uint32_t i, start, end;
+	
+	memset(frame, 0, 4096);
+	for (i = 0; i < pcb -> num_segments; i++)
+	{
+		program_segment_t * seg = &pcb -> segments[i];
+		
+		//file bytes of the segment that are on the page
+		start = (seg -> vaddr > addr) ? seg -> vaddr : addr;
+		end = seg -> vaddr + seg -> filesz;
+		if (end > addr + 4096)
+			end = addr + 4096;
+		if (start < end && fs_boot != NULL)
+		{
+			vol = fs_boot;
+			read_data(pcb -> exe_inode, seg -> offset + (start - seg -> vaddr), frame + (start - addr), end - start);
+		}
+	}
+	
+	vol = prev;
+}
+
+/*
+ * get_program_page
+ *   DESCRIPTION:	Gets the frame for a page of a process's program memory.
+ *					Pages holding bytes of the executable are kept in the
+ *					program page cache, so every process running the program
+ *					shares one frame until it writes to it. Pages of the
+ *					segments that are only zeros (.bss) get a frame of
+ *					their own.
+ *   INPUTS: 		pcb   - pcb of the process
+ *					addr  - virtual address of the page
+ *					frame - filled with the frame, 0 if none could be
+ *							allocated
+ *   OUTPUTS: 		None
+ *   RETURN VALUE: 	PROGRAM_PAGE_ flags of the page, -1 if no segment is on
+ *					the page (and frame is left alone)
+ *   SIDE EFFECTS: 	The caller gets a reference to the frame
+ */
+int32_t get_program_page(pcb_t * pcb, uint32_t addr, uint32_t * frame){
+	int32_t flags = program_page_flags(pcb, addr);
+	program_page_t * slot = NULL;
+	uint32_t i;
+	
+	if (flags == -1)
+		return -1;
+	
+	if (flags & PROGRAM_PAGE_FILE)
+	{
+		//a process running the same program already read it
+		for (i = 0; i < PROGRAM_CACHE_PAGES; i++)
+		{
+			if (program_cache[i].frame == 0)
+			{
+				if (slot == NULL)
+					slot = &program_cache[i];
+				continue;
+			}
+			if (program_cache[i].inode == pcb -> exe_inode && program_cache[i].vaddr == addr)
+			{
+				program_cache_stats.hits++;
+				page_ref(program_cache[i].frame);
+				*frame = program_cache[i].frame;
+				return program_cache[i].flags;
+			}
+		}
+	}
+	
+	*frame = page_alloc();
+	if (*frame == 0)
+		return flags;
+	load_program_page(pcb, addr, (uint8_t *)*frame);
+	if (!(flags & PROGRAM_PAGE_FILE))
+		return flags;
+	
+	//keep it for the next process running the program, replacing slots in turn
+	program_cache_stats.misses++;
+	if (slot == NULL)
+	{
+		slot = &program_cache[program_cache_next];
+		program_cache_next = (program_cache_next + 1) % PROGRAM_CACHE_PAGES;
+		page_unref(slot -> frame);
+		program_cache_stats.evictions++;
+	}
+	flags |= PROGRAM_PAGE_SHARED;
+	page_ref(*frame);
+	slot -> inode = pcb -> exe_inode;
+	slot -> vaddr = addr;
+	slot -> frame = *frame;
+	slot -> flags = flags;
+	return flags;
+}
+
+/*
+ * program_cache_get_stats
+ *   DESCRIPTION:	Copies the program page cache counters
+ *   INPUTS:		stats - structure to fill
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS: 	None
+ */
+void program_cache_get_stats(program_cache_stats_t * stats){
+	if (stats != NULL)
+		*stats = program_cache_stats;
+}
+
+/*
+ * print_program_cache_stats
+ *   DESCRIPTION:	Prints the program page cache counters to display
+ *   INPUTS:		None
+ *   OUTPUTS: 		None
+ *   RETURN VALUE:	None 
+ *   SIDE EFFECTS: 	Prints to screen
+ */
+void print_program_cache_stats(){
+	printf("\nshared       : %d", program_cache_stats.hits);
+	printf("\nread         : %d", program_cache_stats.misses);
+	printf("\nevictions    : %d", program_cache_stats.evictions);
+	printf("\ninvalidations: %d\n", program_cache_stats.invalidations);
+}
+
 /*
  * load_program
- *   DESCRIPTION:	Loads program into memory
+ *   DESCRIPTION:	Sets up a program to be loaded into memory as its
+ *					pages are touched
  *   INPUTS: 		program_name - name of program to load
  *					esp - Location to store value of %ESP 
  *					eip - Location to store value of %EIP
@@ -433,7 +2443,6 @@ int32_t is_valid_cmd(dentry_t * executable, const uint8_t* program_name){
  *   SIDE EFFECTS: 	None
  */
 pcb_t *load_program(const uint8_t* program_name, uint32_t *esp, uint32_t *eip, int pid){
-	uint8_t *program_mem;
 	pcb_t * pcb;
 	
 	//only load if program is valid and executable
@@ -442,24 +2451,17 @@ pcb_t *load_program(const uint8_t* program_name, uint32_t *esp, uint32_t *eip, i
 		return NULL;
 	}
 	
-	//Load file into memory
-	program_mem = (uint8_t *)(_128MB + EXE_OFFSET);  //128MB virtual
+	//Only read the segments, their pages at 128MB virtual are read in from
+	//the file and the rest of the 4MB is zeroed as it's first touched
 	pcb = (pcb_t *)(_8MB - (pid*_8KB));   			//pcb located at (bottom 8KB * process id) of kernel 
-	pcb -> pid = pid;
-	
-	int i;
-	for (i = 0; i < _4MB - EXE_OFFSET; i++){
-		*(program_mem + i) = 0x00;
+	if (read_elf_segments(executable.inode_num, pcb, eip) == -1){
+		return NULL;
 	}
-	
-	uint32_t f_size = file_size(executable.inode_num);
-	read_data(executable.inode_num, 0, program_mem, f_size);
-	
-	//Set EIP
-	*eip = *((uint32_t *)(program_mem + 24));
+	pcb -> exe_inode = executable.inode_num;
+	pcb -> pid = pid;
 	
 	//Set ESP
-	*esp = (uint32_t)(program_mem - EXE_OFFSET + _4MB);
+	*esp = (uint32_t)(_128MB + _4MB);
 	
 	return pcb;
 }
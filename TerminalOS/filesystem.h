@@ -5,11 +5,63 @@
 #ifndef _FILESYSTEM_H
 #define _FILESYSTEM_H
 
+//Host tools (fstools/) only use the on-disk format definitions
+#ifdef FS_HOST_TOOL
+#include <stdint.h>
+#else
 #include "types.h"
 #include "lib.h"
+#include "block_cache.h"
+#endif
 
 #define FILE_ARRAY_OFFSET (24+32)
-#define EXE_OFFSET 0x48000
+
+//Slots in the file name index (power of 2, more than twice the most directory entries)
+#define FS_NAME_HASH_SIZE 8192
+
+//Largest inode count covered by the inode to dentry reverse map
+#define FS_MAX_INODES 4096
+
+//Largest data block count covered by the free block bitmap
+#define FS_MAX_DATA_BLOCKS 16384
+
+//Directory entries that fit in the v1 boot block after its 64B header
+#define FS_MAX_DENTRIES 63
+
+//Directory entries a v2 directory may hold (63 directory blocks of 64)
+#define FS_MAX_DENTRIES_V2 4032
+#define FS_DENTRY_SIZE 64
+#define FS_DENTRIES_PER_BLOCK 64
+
+//Data block slots in a v1 inode
+#define FS_MAX_FILE_BLOCKS 1023
+
+//v2 superblock identification ("FSV2" in the v1 boot block's reserved bytes)
+#define FS_MAGIC 0x32565346
+#define FS_VERSION_2 2
+
+//v2 inodes are packed 64 to a block, each with 6 extents and an optional
+//extent block holding 512 more
+#define FS_INODES_PER_BLOCK 64
+#define FS_INLINE_EXTENTS 6
+#define FS_EXTENTS_PER_BLOCK 512
+#define FS_MAX_EXTENTS (FS_INLINE_EXTENTS + FS_EXTENTS_PER_BLOCK)
+
+//Images that can be mounted at once
+#define FS_MAX_VOLUMES 4
+
+//Slots in the dentry cache (power of 2) and most path components walked
+#define FS_DCACHE_SIZE 256
+#define FS_MAX_PATH_DEPTH 16
+
+//Readahead window bounds in blocks (kept well under BCACHE_BLOCKS)
+#define FS_RA_MIN_WINDOW 2
+#define FS_RA_MAX_WINDOW 16
+
+//lseek whence values
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
 
 //Directory Entry Stucture
 typedef struct dentry{
@@ -20,27 +72,266 @@ typedef struct dentry{
 	// 0 - User Access to RTC
 	// 1 - Directory
 	// 2 - Regular File
+	// 3 - Scratch File (tmpfs)
 	uint32_t file_type;
 
 	// Index Node Number
 	uint32_t inode_num; 
 }dentry_t;
  
-//file operations table structure
+//First 64B of the image. v1 images only fill the three counts, v2 images
+//set magic and version and keep their directory in a directory inode.
+typedef struct superblock{
+	uint32_t num_dentries;
+	uint32_t num_inodes;
+	uint32_t num_data_blocks;
+	uint32_t magic;			//FS_MAGIC for v2, 0 for v1
+	uint32_t version;
+	uint32_t inode_blocks;	//v2: blocks of packed inodes after the superblock
+	uint32_t root_inode;	//v2: inode whose data holds the directory entries
+	uint32_t reserved[9];
+}superblock_t;
+
+//Directory entry as stored in the image (64B)
+typedef struct disk_dentry{
+	char file_name[32];		//not null terminated if 32 characters long
+	uint32_t file_type;
+	uint32_t inode_num;
+	uint8_t reserved[24];
+}disk_dentry_t;
+
+//Index Node Structure (v1, one 4KB block in the image)
+typedef struct inode{
+	//Length of file in bytes
+	uint32_t length;
+	
+	//Data block indices of the file in order
+	uint32_t data_blocks[1023];
+}inode_t;
+
+//Run of consecutive data blocks
+typedef struct fs_extent{
+	uint32_t start;			//first data block index
+	uint32_t count;			//number of blocks
+}fs_extent_t;
+
+//Index Node Structure (v2, 64B)
+typedef struct inode_v2{
+	//Length of file in bytes
+	uint32_t length;
+	
+	//Extents in use, the first FS_INLINE_EXTENTS are held here and the
+	//rest in extent_block
+	uint32_t num_extents;
+	uint32_t extent_block;
+	uint32_t reserved;
+	fs_extent_t extents[FS_INLINE_EXTENTS];
+}inode_v2_t;
+
+//In-memory inode table entry
+typedef struct inode_info{
+	uint32_t used;			//1 if a directory entry refers to the inode
+	uint32_t num_blocks;	//data blocks held by the inode
+}inode_info_t;
+
+//Name lookup counters
+typedef struct fs_lookup_stats{
+	uint32_t lookups;	//calls to read_dentry_by_name
+	uint32_t hits;		//names found
+	uint32_t misses;	//names not found
+	uint32_t probes;	//index slots looked at over all lookups
+	uint32_t max_probe;	//longest single probe sequence
+}fs_lookup_stats_t;
+
+//Dentry cache slot, keyed by the inode of the directory holding the entry
+//and the entry's name
+typedef struct fs_dcache_entry{
+	uint32_t valid;
+	uint32_t parent;
+	dentry_t dentry;
+}fs_dcache_entry_t;
+
+//Dentry cache counters
+typedef struct fs_dcache_stats{
+	uint32_t lookups;	//path components looked up
+	uint32_t hits;		//components found in the cache
+	uint32_t misses;	//components looked up in their directory
+	uint32_t evictions;	//valid slots replaced
+}fs_dcache_stats_t;
+
+//File metadata filled by stat and fstat
+typedef struct fs_stat{
+	uint32_t size;			//bytes in a regular file, 0 otherwise
+	uint32_t type;			//file type from the directory entry
+	uint32_t inode;
+	uint32_t blocks;		//4KB data blocks holding the file
+}stat_t;
+
+//Readahead counters
+typedef struct fs_readahead_stats{
+	uint32_t sequential;	//reads that continued where the last one stopped
+	uint32_t random;		//reads that didn't
+	uint32_t window;		//window of the last read
+	uint32_t max_window;
+}fs_readahead_stats_t;
+
+#ifndef FS_HOST_TOOL
+
+//Mounted image and everything built from it at mount time
+typedef struct fs_volume{
+	//Address of the start of the image (its boot block), the boot block
+	//(v1) or superblock (v2) there and the format version
+	uint32_t base;
+	superblock_t * sb;
+	uint32_t version;
+	
+	//Address of the first data block and number of data blocks
+	uint32_t data;
+	uint32_t num_data_blocks;
+	
+	//Block device holding the image and its block number of the first data block
+	block_dev_t dev;
+	uint32_t data_block;
+	
+	//Data blocks that can be used in place at data (all of them unless the
+	//image is compressed), and whether the image refuses changes
+	uint32_t mapped_blocks;
+	uint32_t read_only;
+	
+	//Inode standing for the root directory (the v2 directory inode, or the
+	//inode of the "." entry in the v1 boot block)
+	uint32_t root_inode;
+	
+	//Hash index of file names (holds directory index + 1, 0 if empty)
+	int32_t name_index[FS_NAME_HASH_SIZE];
+	
+	//Reverse map of inode number to directory index + 1 (0 if no dentry uses the inode)
+	int32_t inode_index[FS_MAX_INODES];
+	
+	//In-memory inode table, free data block bitmap (bit set if the block is
+	//in use) and the next block to try when allocating
+	inode_info_t inode_table[FS_MAX_INODES];
+	uint32_t block_bitmap[FS_MAX_DATA_BLOCKS / 32];
+	uint32_t alloc_hint;
+	
+	//Path components already resolved, direct mapped by (directory inode, name)
+	fs_dcache_entry_t dcache[FS_DCACHE_SIZE];
+	
+	//Counters
+	fs_lookup_stats_t lookup_stats;
+	fs_readahead_stats_t readahead_stats;
+	fs_dcache_stats_t dcache_stats;
+}fs_volume_t;
+
+//File of an image mapped by mmap. Its blocks stay where they are while
+//it is mapped: shrinking it fails and writes go straight to the image.
+#define FS_MAX_MAPPED_FILES 16
+typedef struct fs_mapped_file{
+	fs_volume_t * volume;
+	uint32_t inode;
+	uint32_t count;			//mappings of the file in every process, 0 if the slot is free
+}fs_mapped_file_t;
+
+//ioctl commands, a driver returns -1 for the ones it doesn't support
+#define FIOC_STAT 1			//arg: stat_t * to fill
+#define FIOC_TRUNCATE 2		//arg: new length in bytes
+#define FIOC_GETDENTS 3		//arg: file_io_t *, returns bytes filled
+#define FIOC_PREAD 4		//arg: file_io_t *, returns bytes read
+#define FIOC_MAP_PAGE 5		//arg: file_page_t *, fills in the page's address
+#define FIOC_SETCLOEXEC 6	//no arg, exec closes the descriptor (not passed to the driver)
+#define FIOC_CLRCLOEXEC 7	//no arg, the descriptor stays open across exec
+#define FIOC_READAHEAD_STATS 8	//arg: fs_readahead_stats_t * of the file's image to fill
+#define FIOC_BCACHE_STATS 9		//arg: bcache_stats_t * to fill, the cache every image shares
+#define FIOC_DCACHE_STATS 10	//arg: fs_dcache_stats_t * of the file's image to fill
+#define FIOC_LOOKUP_STATS 11	//arg: fs_lookup_stats_t * of the file's image to fill
+#define FIOC_PROGRAM_CACHE_STATS 12	//arg: program_cache_stats_t * to fill
+
+//Buffer and offset of an ioctl that moves data
+typedef struct file_io{
+	void * buf;
+	int32_t nbytes;
+	uint32_t offset;
+}file_io_t;
+
+//Page of a file to find in memory for mmap
+typedef struct file_page{
+	uint32_t page;			//index of the 4KB page in the file
+	uint32_t address;		//filled with the page's address
+}file_page_t;
+
+//file operations table structure, every operation gets the open file and
+//a NULL entry means the operation isn't supported. dup is called on the
+//copy of an open file a forked process gets, NULL if the copy needs nothing.
+struct file;
 typedef struct file_operations{
-	int32_t (*open)();
-	int32_t (*read)(void* buf, int32_t nbytes);
-	int32_t (*write)(const void* buf, int32_t nbytes);
+	int32_t (*open)(struct file * file);
+	int32_t (*read)(struct file * file, void* buf, int32_t nbytes);
+	int32_t (*write)(struct file * file, const void* buf, int32_t nbytes);
+	int32_t (*close)(struct file * file);
+	int32_t (*seek)(struct file * file, int32_t offset, int32_t whence);
+	int32_t (*ioctl)(struct file * file, uint32_t cmd, uint32_t arg);
+	int32_t (*dup)(struct file * file);
 }file_operations_t;
 
 //file structure
 typedef struct file {
 	uint32_t f_pos;
-	file_operations_t f_ops;
+	const file_operations_t * f_ops;
+	void * f_private;		//driver state of the open file
 	uint32_t eof;
+	uint32_t f_cloexec;		//1 if exec closes the descriptor
 	dentry_t f_dentry;
+	
+	//Regular file state cached by fs_open
+	uint32_t f_length;		//file size in bytes
+	uint32_t f_block;		//index of the file block holding f_pos
+	uint32_t f_block_off;	//offset of f_pos inside that block
+	
+	//Readahead state of a regular file
+	uint32_t f_ra_pos;		//f_pos a sequential read would start at
+	uint32_t f_ra_window;	//number of blocks to keep read ahead of f_pos
+	uint32_t f_ra_end;		//first file block not yet asked for
 }file_t;
 
+//Loadable segments a program may have
+#define PCB_MAX_SEGMENTS 4
+
+//Files a process can have mapped at once
+#define PCB_MAX_MMAPS 8
+
+//Pages of programs kept for other processes running the same executable
+#define PROGRAM_CACHE_PAGES 256
+
+//Flags of a program page from get_program_page
+#define PROGRAM_PAGE_WRITABLE 1		//a segment on the page is writable
+#define PROGRAM_PAGE_FILE 2			//the page holds bytes of the executable
+#define PROGRAM_PAGE_SHARED 4		//the frame is shared through the program page cache
+
+//Segment of a program's memory, read from its executable on first touch
+typedef struct program_segment{
+	uint32_t vaddr;		//first address
+	uint32_t memsz;		//bytes of memory
+	uint32_t offset;	//file offset of the first byte
+	uint32_t filesz;	//bytes read from the file, the rest are zero
+	uint32_t writable;	//1 if the program may write to it
+}program_segment_t;
+
+//Page of a program read from its executable on the boot volume
+typedef struct program_page{
+	uint32_t inode;		//executable
+	uint32_t vaddr;		//virtual address of the page
+	uint32_t frame;		//frame holding it, 0 for an empty slot
+	uint32_t flags;		//PROGRAM_PAGE_ flags
+}program_page_t;
+
+//Program page cache counters
+typedef struct program_cache_stats{
+	uint32_t hits;			//pages shared with a process already running the program
+	uint32_t misses;		//pages read from the executable
+	uint32_t evictions;		//pages replaced by another
+	uint32_t invalidations;	//pages dropped because the executable changed
+}program_cache_stats_t;
+
 //pcb structure 
 typedef struct pcb{
 	int pid;
@@ -66,6 +357,17 @@ typedef struct pcb{
 	uint32_t ret_flags;
 	uint32_t parent_esp;
 	int8_t args[32];
+	uint32_t mmap_next;            //next free page of the file mapping area
+	uint32_t num_mmaps;
+	fs_mapped_file_t * mmap_files[PCB_MAX_MMAPS];   //files mapped in the area
+	int blocked;                   //waiting in execute for its child to halt
+	int detached;                  //made by fork or spawn, no parent waits in execute for it
+	int exited;                    //halted, keeps its pid until the parent calls waitpid
+	int exit_status;               //halt status for waitpid
+	int waiting;                   //blocked in waitpid until a child halts
+	uint32_t exe_inode;            //executable on the boot volume
+	uint32_t num_segments;
+	program_segment_t segments[PCB_MAX_SEGMENTS];
 }pcb_t;
 
 
@@ -73,28 +375,51 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
 int32_t read_dentry_by_dir_index (uint32_t index, dentry_t* dentry);
 void print_dentry(dentry_t entry);
+void fs_get_lookup_stats(fs_lookup_stats_t * stats);
+void print_lookup_stats();
+void fs_get_dcache_stats(fs_dcache_stats_t * stats);
+void print_dcache_stats();
+void fs_get_readahead_stats(fs_readahead_stats_t * stats);
+void print_readahead_stats();
+int32_t fs_stats_ioctl(uint32_t cmd, uint32_t arg);
 int32_t is_valid_cmd(dentry_t * executable, const uint8_t* program_name);
+int32_t get_program_page(pcb_t * pcb, uint32_t addr, uint32_t * frame);
+fs_mapped_file_t * fs_map_file(file_t * file);
+void fs_map_ref(fs_mapped_file_t * mapped);
+void fs_map_release(fs_mapped_file_t * mapped);
+void program_cache_get_stats(program_cache_stats_t * stats);
+void print_program_cache_stats();
  
 int32_t num_dir_entries();
-void fs_init(uint32_t fs_start);
-int32_t fs_open();
-int32_t fs_write(const void* buf, int32_t nbytes);
-int32_t fs_close();
-
- /* Buffer passed into fs_read defined                      *
-  *															*
-  * element 0 - uint32_t 									*
-  *							0 if to read by name			*
-  *							1 if to read by index			*
-  * element 1 - 											*
-  *			(element 0 = 0) start of char array of filename	*
-  *			(element 0 = 1) uint32_t index to read  		*
-  * element 2 -												*
-  *							uint32_t offset					*
-  *															*/
-int32_t fs_read(void* buf, int32_t nbytes);
+fs_volume_t * fs_init(uint32_t fs_start);
+int32_t fs_mount(uint32_t fs_start, const int8_t * name);
+void fs_select(fs_volume_t * volume);
+int32_t fs_open(file_t * file);
+int32_t fs_read_file(file_t * file, void * buf, int32_t nbytes);
+int32_t fs_write_file(file_t * file, const void * buf, int32_t nbytes);
+int32_t fs_truncate(file_t * file, uint32_t length);
+int32_t fs_create(const uint8_t * fname);
+int32_t fs_close(file_t * file);
+int32_t fs_lseek(file_t * file, int32_t offset, int32_t whence);
+int32_t fs_ioctl(file_t * file, uint32_t cmd, uint32_t arg);
+
+//Operations of open regular files
+extern const file_operations_t fs_file_fops;
+
+int32_t fs_lookup(const uint8_t * path, dentry_t * dentry);
+int32_t fs_dir_entries(const dentry_t * dir);
+int32_t fs_read_dir(const dentry_t * dir, uint32_t index, dentry_t * dentry);
+
+int32_t read_data(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length);
+int32_t fs_read(uint32_t inode, uint32_t offset, uint8_t * dest, uint32_t len);
+uint32_t file_size(uint32_t inode);
+int32_t fs_stat(const dentry_t * dentry, stat_t * buf);
+int32_t fs_seek(file_t * file, uint32_t offset);
+uint32_t fs_block_address(file_t * file, uint32_t block);
 
 //Program loader
 pcb_t * load_program(const uint8_t* program_name, uint32_t *esp, uint32_t *eip, int pid);
 
+#endif /* FS_HOST_TOOL */
+
 #endif
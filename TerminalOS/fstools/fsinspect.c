@@ -0,0 +1,566 @@
+/* fsinspect.c
+ * Host tool that dumps a v1 or v2 file system image and checks that its
+ * directory, inodes and data blocks are consistent
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "filesystem.h"
+#include "lz4.h"
+
+#define BLOCK 4096
+
+//Image being inspected and its layout
+uint8_t * image = NULL;
+uint32_t image_blocks = 0;
+superblock_t * sb = NULL;
+uint32_t version = 1;
+uint32_t inode_blocks = 0;
+uint8_t * data = NULL;
+
+//Leading blocks of a compressed image stored uncompressed (0 for a plain
+//image), which must hold everything the kernel uses in place
+uint32_t raw_blocks = 0;
+
+//Data block owners (inode + 1, 0 if free) for finding shared blocks
+uint32_t * owner = NULL;
+
+//Listing options and totals
+int verbose = 0;
+uint32_t files = 0, dirs = 0, total_runs = 0, max_runs = 0;
+
+//Inodes already listed (to find shared inodes and directory loops)
+uint8_t * seen = NULL;
+
+//Problem counters
+uint32_t errors = 0;
+uint32_t warnings = 0;
+
+/*
+ * error
+ *   DESCRIPTION:	Reports an inconsistency in the image
+ *   INPUTS:		fmt, ... - printf style message
+ *   OUTPUTS:		Message on stdout
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	errors is incremented
+ */
+static void error(const char * fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	printf("ERROR: ");
+	vprintf(fmt, args);
+	printf("\n");
+	va_end(args);
+	errors++;
+}
+
+/*
+ * warning
+ *   DESCRIPTION:	Reports something legal but unusual in the image
+ *   INPUTS:		fmt, ... - printf style message
+ *   OUTPUTS:		Message on stdout
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	warnings is incremented
+ */
+static void warning(const char * fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	printf("warning: ");
+	vprintf(fmt, args);
+	printf("\n");
+	va_end(args);
+	warnings++;
+}
+
+/*
+ * claim_block
+ *   DESCRIPTION:	Records that an inode uses a data block, reporting blocks
+ *					out of range or already used by another inode
+ *   INPUTS:		inode - inode using the block
+ *					block - data block index
+ *					what  - name of the user for messages
+ *   OUTPUTS:		Errors on stdout
+ *   RETURN VALUE:	0 if the block is valid, -1 otherwise
+ *   SIDE EFFECTS:	owner changes
+ */
+static int claim_block(uint32_t inode, uint32_t block, const char * what){
+	if (block >= sb -> num_data_blocks)
+	{
+		error("%s: data block %u is past the last data block %u", what, block, sb -> num_data_blocks - 1);
+		return -1;
+	}
+	if (owner[block] != 0 && owner[block] != inode + 1)
+	{
+		error("%s: data block %u is also used by inode %u", what, block, owner[block] - 1);
+		return -1;
+	}
+	owner[block] = inode + 1;
+	return 0;
+}
+
+/*
+ * check_in_place
+ *   DESCRIPTION:	Reports metadata kept in a data block that a compressed
+ *					image stores compressed, where the kernel can't use it
+ *   INPUTS:		block - data block index
+ *					what  - name of the user for messages
+ *   OUTPUTS:		Errors on stdout
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+static void check_in_place(uint32_t block, const char * what){
+	if (raw_blocks != 0 && 1 + inode_blocks + block >= raw_blocks)
+		error("%s: metadata in data block %u is compressed", what, block);
+}
+
+/*
+ * expand_image
+ *   DESCRIPTION:	Replaces a compressed image by the image it expands to,
+ *					checking its header, offset table and every block
+ *   INPUTS:		size - bytes in the compressed image
+ *   OUTPUTS:		Compression summary and errors on stdout
+ *   RETURN VALUE:	0 on success, -1 if the image can't be expanded
+ *   SIDE EFFECTS:	image, image_blocks and raw_blocks change
+ */
+static int expand_image(long size){
+	lz4_header_t * header = (lz4_header_t *)image;
+	uint32_t num = header -> num_blocks - header -> raw_blocks;
+	uint32_t i;
+
+	if (header -> raw_blocks == 0 || header -> raw_blocks > header -> num_blocks ||
+		header -> table != BLOCK * (1 + header -> raw_blocks) || header -> table + ((num + 1) * sizeof(uint32_t)) > size)
+	{
+		printf("ERROR: bad compressed image header\n");
+		return -1;
+	}
+
+	uint8_t * expanded = calloc(header -> num_blocks, BLOCK);
+	uint32_t * table = (uint32_t *)(image + header -> table);
+	memcpy(expanded, image + BLOCK, header -> raw_blocks * BLOCK);
+	for (i = 0; i < num; i++)
+	{
+		uint8_t * block = expanded + ((header -> raw_blocks + i) * BLOCK);
+		if (table[i + 1] < table[i] || table[i + 1] > size)
+		{
+			printf("ERROR: compressed block %u is outside the image\n", header -> raw_blocks + i);
+			return -1;
+		}
+		uint32_t len = table[i + 1] - table[i];
+		if (len == BLOCK)
+			memcpy(block, image + table[i], BLOCK);
+		else if (lz4_decompress(image + table[i], len, block, BLOCK) != BLOCK)
+			error("compressed block %u doesn't expand to %u bytes", header -> raw_blocks + i, BLOCK);
+	}
+
+	printf("compressed  : %ld bytes for %u blocks (%u%%), first %u raw\n", size, header -> num_blocks,
+		(uint32_t)((size * 100) / ((long)header -> num_blocks * BLOCK)), header -> raw_blocks);
+	raw_blocks = header -> raw_blocks;
+	image_blocks = header -> num_blocks;
+	free(image);
+	image = expanded;
+	return 0;
+}
+
+/*
+ * file_blocks
+ *   DESCRIPTION:	Lists the data blocks of an inode in file order, checking
+ *					them and the inode's block count against its length
+ *   INPUTS:		inode  - inode number
+ *					what   - name of the user for messages
+ *					blocks - array of at least FS_MAX_DATA_BLOCKS entries to fill
+ *					runs   - set to the number of runs of consecutive blocks
+ *   OUTPUTS:		Errors on stdout
+ *   RETURN VALUE:	Number of blocks listed
+ *   SIDE EFFECTS:	owner changes
+ */
+static uint32_t file_blocks(uint32_t inode, const char * what, uint32_t * blocks, uint32_t * runs){
+	uint32_t num = 0, i, j;
+	uint32_t length;
+
+	*runs = 0;
+	if (version == FS_VERSION_2)
+	{
+		inode_v2_t * node = (inode_v2_t *)(image + BLOCK) + inode;
+		length = node -> length;
+
+		if (node -> num_extents > FS_MAX_EXTENTS)
+		{
+			error("%s: %u extents, an inode holds at most %u", what, node -> num_extents, FS_MAX_EXTENTS);
+			return 0;
+		}
+		if (node -> num_extents > FS_INLINE_EXTENTS)
+		{
+			if (claim_block(inode, node -> extent_block, what) == -1)
+				return 0;
+			check_in_place(node -> extent_block, what);
+		}
+
+		for (i = 0; i < node -> num_extents; i++)
+		{
+			fs_extent_t * extent = (i < FS_INLINE_EXTENTS) ? &(node -> extents[i]) :
+				(fs_extent_t *)(data + (node -> extent_block * BLOCK)) + (i - FS_INLINE_EXTENTS);
+			if (extent -> count == 0)
+				warning("%s: extent %u is empty", what, i);
+			for (j = 0; j < extent -> count && num < FS_MAX_DATA_BLOCKS; j++)
+			{
+				if (num == 0 || extent -> start + j != blocks[num - 1] + 1)
+					(*runs)++;
+				blocks[num++] = extent -> start + j;
+			}
+		}
+	}
+	else
+	{
+		inode_t * node = (inode_t *)(image + ((inode + 1) * BLOCK));
+		length = node -> length;
+		num = (length + BLOCK - 1) / BLOCK;
+		if (num > FS_MAX_FILE_BLOCKS)
+		{
+			error("%s: length %u needs %u blocks, an inode holds %u", what, length, num, FS_MAX_FILE_BLOCKS);
+			return 0;
+		}
+		for (i = 0; i < num; i++)
+		{
+			if (i == 0 || node -> data_blocks[i] != blocks[i - 1] + 1)
+				(*runs)++;
+			blocks[i] = node -> data_blocks[i];
+		}
+	}
+
+	if (num != (length + BLOCK - 1) / BLOCK)
+		error("%s: length %u needs %u blocks but the inode has %u", what, length, (length + BLOCK - 1) / BLOCK, num);
+
+	for (i = 0; i < num; i++)
+	{
+		if (claim_block(inode, blocks[i], what) == -1)
+			break;
+	}
+	return num;
+}
+
+/*
+ * dentry_at
+ *   DESCRIPTION:	Finds a directory entry (in the boot block for v1, in the
+ *					directory inode's blocks for v2)
+ *   INPUTS:		index    - directory index
+ *					dir      - v2 directory blocks from file_blocks
+ *					num_dir  - number of v2 directory blocks
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Address of the entry, NULL if the directory is too short
+ *   SIDE EFFECTS:	None
+ */
+static disk_dentry_t * dentry_at(uint32_t index, const uint32_t * dir, uint32_t num_dir){
+	if (version != FS_VERSION_2)
+		return (disk_dentry_t *)(image + 64) + index;
+
+	uint32_t block = index / FS_DENTRIES_PER_BLOCK;
+	if (block >= num_dir || dir[block] >= sb -> num_data_blocks)
+		return NULL;
+	return (disk_dentry_t *)(data + (dir[block] * BLOCK)) + (index % FS_DENTRIES_PER_BLOCK);
+}
+
+/*
+ * print_blocks
+ *   DESCRIPTION:	Prints a block list, runs of consecutive blocks as first-last
+ *   INPUTS:		blocks - data blocks
+ *					num    - number of blocks
+ *   OUTPUTS:		Block list on stdout
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+static void print_blocks(const uint32_t * blocks, uint32_t num){
+	uint32_t j;
+
+	printf("    blocks:");
+	for (j = 0; j < num; j++)
+	{
+		uint32_t start = j;
+		while (j + 1 < num && blocks[j + 1] == blocks[j] + 1)
+			j++;
+		if (j == start)
+			printf(" %u", blocks[start]);
+		else
+			printf(" %u-%u", blocks[start], blocks[j]);
+	}
+	printf("\n");
+}
+
+/*
+ * inode_length
+ *   DESCRIPTION:	Reads the length of an inode in the image
+ *   INPUTS:		inode - inode number (already checked)
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Length in bytes
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t inode_length(uint32_t inode){
+	if (version == FS_VERSION_2)
+		return ((inode_v2_t *)(image + BLOCK) + inode) -> length;
+	return ((inode_t *)(image + ((inode + 1) * BLOCK))) -> length;
+}
+
+/*
+ * inspect_dir
+ *   DESCRIPTION:	Lists and checks the entries of a directory, then does the
+ *					same for each subdirectory in it
+ *   INPUTS:		entries - the directory's entries
+ *					num     - number of entries
+ *					path    - path of the directory ("" for the root)
+ *					self    - inode of the directory
+ *					parent  - inode of its parent
+ *					depth   - how deep the directory is below the root
+ *   OUTPUTS:		Listing and problems on stdout
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	owner, seen and the totals change
+ */
+static void inspect_dir(disk_dentry_t ** entries, uint32_t num, const char * path, uint32_t self, uint32_t parent, uint32_t depth){
+	uint32_t * blocks = calloc(FS_MAX_DATA_BLOCKS, sizeof(uint32_t));
+	uint32_t i, j, runs;
+
+	for (i = 0; i < num; i++)
+	{
+		disk_dentry_t * dentry = entries[i];
+		char name[300];
+		snprintf(name, sizeof(name), "%s%.32s", path, dentry -> file_name);
+		if (dentry -> file_name[0] == '\0')
+			error("%s: entry %u has an empty name", path[0] ? path : "/", i);
+		for (j = 0; j < i; j++)
+		{
+			if (strncmp(entries[j] -> file_name, dentry -> file_name, 32) == 0)
+				error("%s: name is also used by entry %u", name, j);
+		}
+		if (dentry -> file_type > 2)
+			error("%s: unknown file type %u", name, dentry -> file_type);
+		if (dentry -> inode_num >= sb -> num_inodes)
+		{
+			error("%s: inode %u is past the last inode", name, dentry -> inode_num);
+			continue;
+		}
+
+		//"." and ".." of a subdirectory point back up the tree
+		int dot = strncmp(dentry -> file_name, ".", 32) == 0;
+		int dotdot = strncmp(dentry -> file_name, "..", 32) == 0;
+		if (dentry -> file_type == 1 && (dot || dotdot))
+		{
+			if (depth > 0 && dentry -> inode_num != (dot ? self : parent))
+				error("%s: points to inode %u instead of %u", name, dentry -> inode_num, dot ? self : parent);
+			printf("%-40s %4u %6u\n", name, dentry -> file_type, dentry -> inode_num);
+			continue;
+		}
+
+		uint32_t num_blocks = 0;
+		runs = 0;
+		if (dentry -> file_type == 1 || dentry -> file_type == 2)
+		{
+			//a second entry for the same inode shares its blocks
+			if (seen[dentry -> inode_num])
+			{
+				warning("%s: inode %u is already listed%s", name, dentry -> inode_num,
+					dentry -> file_type == 1 ? ", not following it" : "");
+				continue;
+			}
+			seen[dentry -> inode_num] = 1;
+			num_blocks = file_blocks(dentry -> inode_num, name, blocks, &runs);
+		}
+		if (dentry -> file_type == 2)
+		{
+			files++;
+			total_runs += runs;
+			if (runs > max_runs)
+				max_runs = runs;
+		}
+
+		uint32_t length = (dentry -> file_type == 0) ? 0 : inode_length(dentry -> inode_num);
+		printf("%-40s %4u %6u %10u %7u %5u\n", name, dentry -> file_type, dentry -> inode_num, length, num_blocks, runs);
+		if (verbose && num_blocks > 0)
+			print_blocks(blocks, num_blocks);
+		if (dentry -> file_type != 1)
+			continue;
+
+		//subdirectory, its data is an array of entries
+		dirs++;
+		if (length % FS_DENTRY_SIZE != 0)
+			error("%s: directory length %u isn't a multiple of %u", name, length, FS_DENTRY_SIZE);
+		if (depth + 1 >= FS_MAX_PATH_DEPTH)
+		{
+			warning("%s: deeper than %u directories, not following it", name, FS_MAX_PATH_DEPTH);
+			continue;
+		}
+		uint32_t num_entries = length / FS_DENTRY_SIZE;
+		if (num_entries > num_blocks * FS_DENTRIES_PER_BLOCK)
+			num_entries = num_blocks * FS_DENTRIES_PER_BLOCK;
+		disk_dentry_t ** children = calloc(num_entries + 1, sizeof(disk_dentry_t *));
+		for (j = 0; j < num_entries; j++)
+		{
+			uint32_t block = blocks[j / FS_DENTRIES_PER_BLOCK];
+			if (block >= sb -> num_data_blocks)
+				break;
+			children[j] = (disk_dentry_t *)(data + (block * BLOCK)) + (j % FS_DENTRIES_PER_BLOCK);
+		}
+		char sub[sizeof(name) + 1];
+		snprintf(sub, sizeof(sub), "%s/", name);
+		inspect_dir(children, j, sub, dentry -> inode_num, self, depth + 1);
+		free(children);
+	}
+	free(blocks);
+}
+
+/*
+ * main
+ *   DESCRIPTION:	Loads an image, prints its layout and directory and checks it
+ *   INPUTS:		argc, argv - [-v] image
+ *   OUTPUTS:		Report on stdout
+ *   RETURN VALUE:	0 if no errors were found, 1 otherwise, 2 on bad usage
+ *   SIDE EFFECTS:	None
+ */
+int main(int argc, char ** argv){
+	int opt;
+	uint32_t i;
+
+	while ((opt = getopt(argc, argv, "v")) != -1)
+	{
+		if (opt == 'v')
+			verbose = 1;
+		else
+			optind = argc + 1;
+	}
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "usage: %s [-v] image\n", argv[0]);
+		return 2;
+	}
+
+	//load the whole image
+	FILE * in = fopen(argv[optind], "rb");
+	if (in == NULL)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	if (size < BLOCK)
+	{
+		printf("ERROR: image is %ld bytes, smaller than the boot block\n", size);
+		return 1;
+	}
+	image_blocks = (size + BLOCK - 1) / BLOCK;
+	image = calloc(image_blocks, BLOCK);
+	if (fread(image, 1, size, in) != (size_t)size)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	fclose(in);
+	if (((lz4_header_t *)image) -> magic == LZ4_IMAGE_MAGIC && expand_image(size) == -1)
+		return 1;
+
+	//layout, detected the way fs_init does
+	sb = (superblock_t *)image;
+	if (sb -> magic == FS_MAGIC)
+	{
+		if (sb -> version != FS_VERSION_2)
+		{
+			printf("ERROR: unknown format version %u\n", sb -> version);
+			return 1;
+		}
+		version = FS_VERSION_2;
+		inode_blocks = sb -> inode_blocks;
+		if (inode_blocks < (sb -> num_inodes + FS_INODES_PER_BLOCK - 1) / FS_INODES_PER_BLOCK)
+		{
+			printf("ERROR: %u inode blocks can't hold %u inodes\n", inode_blocks, sb -> num_inodes);
+			return 1;
+		}
+	}
+	else
+	{
+		inode_blocks = sb -> num_inodes;
+	}
+	uint32_t needed = 1 + inode_blocks + sb -> num_data_blocks;
+	printf("format      : v%u\n", version);
+	printf("dentries    : %u\n", sb -> num_dentries);
+	printf("inodes      : %u (%u blocks)\n", sb -> num_inodes, inode_blocks);
+	printf("data blocks : %u\n", sb -> num_data_blocks);
+	if (needed > image_blocks)
+	{
+		printf("ERROR: layout needs %u blocks, the image has %u\n", needed, image_blocks);
+		return 1;
+	}
+	if (raw_blocks != 0 && raw_blocks < 1 + inode_blocks)
+		error("the first %u blocks are raw, the boot block and inodes take %u", raw_blocks, 1 + inode_blocks);
+	if (needed < image_blocks)
+		warning("%u blocks past the last data block", image_blocks - needed);
+	if (sb -> num_inodes > FS_MAX_INODES)
+		warning("%u inodes, the kernel tracks %u", sb -> num_inodes, FS_MAX_INODES);
+	if (sb -> num_data_blocks > FS_MAX_DATA_BLOCKS)
+		warning("%u data blocks, the kernel allocates from the first %u", sb -> num_data_blocks, FS_MAX_DATA_BLOCKS);
+
+	data = image + ((1 + inode_blocks) * BLOCK);
+	owner = calloc(sb -> num_data_blocks + 1, sizeof(uint32_t));
+	uint32_t * dir = calloc(FS_MAX_DATA_BLOCKS, sizeof(uint32_t));
+	uint32_t num_dir = 0, runs;
+
+	//directory location and size
+	uint32_t max_dentries = FS_MAX_DENTRIES;
+	if (version == FS_VERSION_2)
+	{
+		max_dentries = FS_MAX_DENTRIES_V2;
+		if (sb -> root_inode >= sb -> num_inodes)
+		{
+			printf("ERROR: directory inode %u is past the last inode\n", sb -> root_inode);
+			return 1;
+		}
+		num_dir = file_blocks(sb -> root_inode, "directory", dir, &runs);
+		uint32_t dir_length = ((inode_v2_t *)(image + BLOCK) + sb -> root_inode) -> length;
+		printf("directory   : inode %u, %u blocks\n", sb -> root_inode, num_dir);
+		for (i = 0; i < num_dir; i++)
+			check_in_place(dir[i], "directory");
+		if (dir_length != sb -> num_dentries * FS_DENTRY_SIZE)
+			error("directory length %u doesn't match %u entries", dir_length, sb -> num_dentries);
+	}
+	if (sb -> num_dentries > max_dentries)
+	{
+		printf("ERROR: %u entries, a v%u directory holds %u\n", sb -> num_dentries, version, max_dentries);
+		return 1;
+	}
+
+	//entries, subdirectories are listed after the entry naming them
+	seen = calloc(sb -> num_inodes, 1);
+	printf("\n%-40s %4s %6s %10s %7s %5s\n", "name", "type", "inode", "length", "blocks", "runs");
+	disk_dentry_t ** entries = calloc(sb -> num_dentries + 1, sizeof(disk_dentry_t *));
+	for (i = 0; i < sb -> num_dentries; i++)
+	{
+		entries[i] = dentry_at(i, dir, num_dir);
+		if (entries[i] == NULL)
+		{
+			error("entry %u is past the directory's blocks", i);
+			break;
+		}
+	}
+	uint32_t root = (version == FS_VERSION_2) ? sb -> root_inode : 0;
+	if (root < sb -> num_inodes)
+		seen[root] = 1;
+	inspect_dir(entries, i, "", root, root, 0);
+	free(entries);
+
+	//summary
+	uint32_t claimed = 0;
+	for (i = 0; i < sb -> num_data_blocks; i++)
+	{
+		if (owner[i] != 0)
+			claimed++;
+	}
+	printf("\nregular files : %u\n", files);
+	printf("directories   : %u\n", dirs + 1);
+	printf("blocks in use : %u of %u (%u free)\n", claimed, sb -> num_data_blocks, sb -> num_data_blocks - claimed);
+	if (files > 0)
+		printf("runs per file : %u.%02u average, %u most\n", total_runs / files, ((total_runs % files) * 100) / files, max_runs);
+	printf("%u errors, %u warnings\n", errors, warnings);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,623 @@
+/* mkfs.c
+ * Host tool that packs the regular files of a directory (and generated
+ * files) into a file system image in the v1 or v2 format of filesystem.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "filesystem.h"
+#include "lz4.h"
+
+#define BLOCK 4096
+
+//File to pack
+typedef struct mkfs_file{
+	char name[32];
+	uint32_t type;
+	uint32_t inode;
+	uint8_t * data;
+	uint32_t length;
+	uint32_t num_blocks;
+	uint32_t * blocks;		//data block of each file block
+	int32_t parent;			//index of the subdirectory holding it, -1 for the root
+	uint32_t subdir;		//1 for a subdirectory, whose data is its entries
+}mkfs_file_t;
+
+//Files in directory order, "." and "rtc" first, a subdirectory's entries
+//after it
+mkfs_file_t * files = NULL;
+uint32_t num_files = 0;
+
+/*
+ * usage
+ *   DESCRIPTION:	Prints the command line options and exits
+ *   INPUTS:		prog - program name
+ *   OUTPUTS:		Usage text on stderr
+ *   RETURN VALUE:	None (exits with status 2)
+ *   SIDE EFFECTS:	Ends the program
+ */
+static void usage(const char * prog){
+	fprintf(stderr,
+		"usage: %s [-1|-2] [-i inodes] [-b blocks] [-n count:size] [-F] [-z] -o image [dir]\n"
+		"  -1, -2        image format version (default 1)\n"
+		"  -i inodes     number of inodes (default: one per file plus one)\n"
+		"  -b blocks     number of data blocks (default: as many as the files need)\n"
+		"  -n count:size add count generated files of size bytes named fNNNN\n"
+		"  -F            fragment files by handing out their blocks round robin\n"
+		"  -z            compress the file data blocks with LZ4\n"
+		"  -o image      image file to write\n"
+		"  dir           directory whose regular files are packed\n", prog);
+	exit(2);
+}
+
+/*
+ * set_data
+ *   DESCRIPTION:	Sets the contents of a file and sizes its block list
+ *   INPUTS:		file   - file in the list
+ *					data   - contents (malloc'ed, owned by the list)
+ *					length - bytes in data
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	file changes
+ */
+static void set_data(mkfs_file_t * file, uint8_t * data, uint32_t length){
+	file -> data = data;
+	file -> length = length;
+	file -> num_blocks = (length + BLOCK - 1) / BLOCK;
+	free(file -> blocks);
+	file -> blocks = calloc(file -> num_blocks + 1, sizeof(uint32_t));
+}
+
+/*
+ * add_file
+ *   DESCRIPTION:	Adds a file to the list to pack
+ *   INPUTS:		name   - file name (at most 32 characters)
+ *					type   - file type (0 rtc, 1 directory, 2 regular file)
+ *					data   - file contents (malloc'ed, owned by the list)
+ *					length - bytes in data
+ *					parent - index of the subdirectory holding it, -1 for the root
+ *   OUTPUTS:		Error on stderr for a bad name
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	files grows
+ */
+static int add_file(const char * name, uint32_t type, uint8_t * data, uint32_t length, int32_t parent){
+	if (strlen(name) == 0 || strlen(name) > 32)
+	{
+		fprintf(stderr, "mkfs: bad file name '%s'\n", name);
+		return -1;
+	}
+
+	files = realloc(files, (num_files + 1) * sizeof(mkfs_file_t));
+	mkfs_file_t * file = &files[num_files++];
+	memset(file, 0, sizeof(mkfs_file_t));
+	memcpy(file -> name, name, strlen(name));		//32 character names aren't null terminated
+	file -> type = type;
+	file -> parent = parent;
+	set_data(file, data, length);
+	return 0;
+}
+
+/*
+ * compare_names
+ *   DESCRIPTION:	qsort comparison of directory entry names
+ *   INPUTS:		a, b - pointers to char * names
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	strcmp order of the names
+ *   SIDE EFFECTS:	None
+ */
+static int compare_names(const void * a, const void * b){
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * add_dir
+ *   DESCRIPTION:	Adds every regular file and subdirectory of a host
+ *					directory, in name order, and the subdirectories' contents
+ *   INPUTS:		path   - host directory
+ *					parent - index of the subdirectory it becomes, -1 for the root
+ *					depth  - how deep path is below the root directory
+ *   OUTPUTS:		Warnings for skipped entries on stderr
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	files grows
+ */
+static int add_dir(const char * path, int32_t parent, uint32_t depth){
+	DIR * dir = opendir(path);
+	if (dir == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+
+	char ** names = NULL;
+	uint32_t num_names = 0;
+	struct dirent * ent;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (ent -> d_name[0] == '.')
+			continue;
+		names = realloc(names, (num_names + 1) * sizeof(char *));
+		names[num_names++] = strdup(ent -> d_name);
+	}
+	closedir(dir);
+	qsort(names, num_names, sizeof(char *), compare_names);
+
+	uint32_t i;
+	int retval = 0;
+	for (i = 0; i < num_names && retval == 0; i++)
+	{
+		char full[4096];
+		struct stat st;
+		snprintf(full, sizeof(full), "%s/%s", path, names[i]);
+		if (stat(full, &st) == 0 && S_ISDIR(st.st_mode) && depth < FS_MAX_PATH_DEPTH)
+		{
+			retval = add_file(names[i], 1, NULL, 0, parent);
+			if (retval == 0)
+			{
+				files[num_files - 1].subdir = 1;
+				retval = add_dir(full, num_files - 1, depth + 1);
+			}
+			continue;
+		}
+		if (stat(full, &st) == -1 || !S_ISREG(st.st_mode))
+		{
+			fprintf(stderr, "mkfs: skipping %s (not a regular file or directory)\n", full);
+			continue;
+		}
+
+		FILE * in = fopen(full, "rb");
+		uint8_t * data = malloc(st.st_size + 1);
+		if (in == NULL || fread(data, 1, st.st_size, in) != (size_t)st.st_size)
+		{
+			perror(full);
+			retval = -1;
+		}
+		else
+		{
+			retval = add_file(names[i], 2, data, st.st_size, parent);
+		}
+		if (in != NULL)
+			fclose(in);
+	}
+
+	for (i = 0; i < num_names; i++)
+		free(names[i]);
+	free(names);
+	return retval;
+}
+
+/*
+ * add_generated
+ *   DESCRIPTION:	Adds files filled with a repeating pattern, named fNNNN
+ *   INPUTS:		spec - "count:size"
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on a bad spec
+ *   SIDE EFFECTS:	files grows
+ */
+static int add_generated(const char * spec){
+	unsigned long count, size, i, j;
+	if (sscanf(spec, "%lu:%lu", &count, &size) != 2)
+		return -1;
+
+	for (i = 0; i < count; i++)
+	{
+		char name[33];
+		uint8_t * data = malloc(size + 1);
+		snprintf(name, sizeof(name), "f%04lu", i);
+		for (j = 0; j < size; j++)
+			data[j] = (uint8_t)((i * 31) + j);
+		if (add_file(name, 2, data, size, -1) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * put_dentry
+ *   DESCRIPTION:	Fills a directory entry as stored in the image
+ *   INPUTS:		dentry - entry to fill
+ *					name   - name (not null terminated if 32 characters long)
+ *					type   - file type
+ *					inode  - inode number
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+static void put_dentry(disk_dentry_t * dentry, const char * name, uint32_t type, uint32_t inode){
+	memset(dentry, 0, sizeof(disk_dentry_t));
+	memcpy(dentry -> file_name, name, strnlen(name, 32));
+	dentry -> file_type = type;
+	dentry -> inode_num = inode;
+}
+
+/*
+ * build_subdirs
+ *   DESCRIPTION:	Makes the data of every subdirectory: a "." entry for
+ *					itself, a ".." entry for its parent (inode 0 for the root
+ *					directory) and its own entries in order
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Subdirectories' data and block lists change
+ */
+static void build_subdirs(){
+	uint32_t i, j;
+
+	for (i = 0; i < num_files; i++)
+	{
+		if (!files[i].subdir)
+			continue;
+
+		uint32_t num = 2;
+		for (j = 0; j < num_files; j++)
+		{
+			if (files[j].parent == (int32_t)i)
+				num++;
+		}
+
+		disk_dentry_t * entries = calloc(num, sizeof(disk_dentry_t));
+		put_dentry(&entries[0], ".", 1, files[i].inode);
+		put_dentry(&entries[1], "..", 1, (files[i].parent == -1) ? 0 : files[files[i].parent].inode);
+		num = 2;
+		for (j = 0; j < num_files; j++)
+		{
+			if (files[j].parent == (int32_t)i)
+				put_dentry(&entries[num++], files[j].name, files[j].type, files[j].inode);
+		}
+		set_data(&files[i], (uint8_t *)entries, num * sizeof(disk_dentry_t));
+	}
+}
+
+/*
+ * place_blocks
+ *   DESCRIPTION:	Chooses the data block of every file block, one file after
+ *					another, or one block of each file in turn when fragmenting
+ *   INPUTS:		first    - first data block to hand out
+ *					fragment - 1 to interleave the files' blocks
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Next free data block
+ *   SIDE EFFECTS:	Fills each file's blocks
+ */
+static uint32_t place_blocks(uint32_t first, int fragment){
+	uint32_t next = first;
+	uint32_t i, j;
+
+	if (!fragment)
+	{
+		for (i = 0; i < num_files; i++)
+			for (j = 0; j < files[i].num_blocks; j++)
+				files[i].blocks[j] = next++;
+		return next;
+	}
+
+	uint32_t round, placed = 1;
+	for (round = 0; placed; round++)
+	{
+		placed = 0;
+		for (i = 0; i < num_files; i++)
+		{
+			if (round < files[i].num_blocks)
+			{
+				files[i].blocks[round] = next++;
+				placed = 1;
+			}
+		}
+	}
+	return next;
+}
+
+/*
+ * count_extents
+ *   DESCRIPTION:	Counts the runs of consecutive data blocks of a file
+ *   INPUTS:		file - file with placed blocks
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of extents a v2 inode needs for the file
+ *   SIDE EFFECTS:	None
+ */
+static uint32_t count_extents(const mkfs_file_t * file){
+	uint32_t j, extents = 0;
+	for (j = 0; j < file -> num_blocks; j++)
+	{
+		if (j == 0 || file -> blocks[j] != file -> blocks[j-1] + 1)
+			extents++;
+	}
+	return extents;
+}
+
+/*
+ * write_extents
+ *   DESCRIPTION:	Stores a file's blocks as extents in its v2 inode, spilling
+ *					into the given extent block past FS_INLINE_EXTENTS
+ *   INPUTS:		node         - v2 inode in the image
+ *					file         - file with placed blocks
+ *					extent_block - data block for extra extents (if needed)
+ *					data         - start of the data blocks in the image
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Inode and extent block are filled
+ */
+static void write_extents(inode_v2_t * node, const mkfs_file_t * file, uint32_t extent_block, uint8_t * data){
+	uint32_t j;
+	fs_extent_t * extent = NULL;
+
+	for (j = 0; j < file -> num_blocks; j++)
+	{
+		if (extent != NULL && file -> blocks[j] == extent -> start + extent -> count)
+		{
+			extent -> count++;
+			continue;
+		}
+
+		if (node -> num_extents < FS_INLINE_EXTENTS)
+			extent = &(node -> extents[node -> num_extents]);
+		else
+			extent = (fs_extent_t *)(data + (extent_block * BLOCK)) + (node -> num_extents - FS_INLINE_EXTENTS);
+		extent -> start = file -> blocks[j];
+		extent -> count = 1;
+		node -> num_extents++;
+	}
+	if (node -> num_extents > FS_INLINE_EXTENTS)
+		node -> extent_block = extent_block;
+}
+
+/*
+ * write_compressed
+ *   DESCRIPTION:	Writes an image in the compressed format of lz4.h: the
+ *					header, the first raw_blocks blocks as they are, the block
+ *					offset table and the rest of the blocks compressed one by
+ *					one (kept as they are if compressing doesn't shrink them)
+ *   INPUTS:		out          - image file to write
+ *					image        - uncompressed image
+ *					image_blocks - blocks in image
+ *					raw_blocks   - leading blocks the kernel uses in place
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Bytes written, 0 on failure
+ *   SIDE EFFECTS:	Writes the image file
+ */
+static uint32_t write_compressed(FILE * out, const uint8_t * image, uint32_t image_blocks, uint32_t raw_blocks){
+	uint32_t num = image_blocks - raw_blocks;
+	uint32_t i;
+
+	lz4_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LZ4_IMAGE_MAGIC;
+	header.num_blocks = image_blocks;
+	header.raw_blocks = raw_blocks;
+	header.table = BLOCK * (1 + raw_blocks);
+
+	//compress every block first to know the offsets
+	uint8_t * packed = malloc(num * BLOCK + 1);
+	uint32_t * table = malloc((num + 1) * sizeof(uint32_t));
+	uint32_t packed_len = 0;
+	for (i = 0; i < num; i++)
+	{
+		const uint8_t * block = image + ((raw_blocks + i) * BLOCK);
+		uint32_t len = lz4_compress(block, BLOCK, packed + packed_len, BLOCK - 1);
+		if (len == 0)
+		{
+			memcpy(packed + packed_len, block, BLOCK);
+			len = BLOCK;
+		}
+		table[i] = header.table + ((num + 1) * sizeof(uint32_t)) + packed_len;
+		packed_len += len;
+	}
+	table[num] = header.table + ((num + 1) * sizeof(uint32_t)) + packed_len;
+
+	uint8_t pad[BLOCK];
+	uint32_t size = table[num];
+	memset(pad, 0, BLOCK);
+	if (fwrite(&header, sizeof(header), 1, out) != 1 || fwrite(pad, BLOCK - sizeof(header), 1, out) != 1 ||
+		fwrite(image, BLOCK, raw_blocks, out) != raw_blocks || fwrite(table, sizeof(uint32_t), num + 1, out) != num + 1 ||
+		fwrite(packed, 1, packed_len, out) != packed_len)
+		size = 0;
+
+	free(packed);
+	free(table);
+	return size;
+}
+
+/*
+ * main
+ *   DESCRIPTION:	Builds the image described by the command line
+ *   INPUTS:		argc, argv - see usage
+ *   OUTPUTS:		Image file and a one line summary on stdout
+ *   RETURN VALUE:	0 on success, 1 on failure, 2 on bad usage
+ *   SIDE EFFECTS:	Writes the image file
+ */
+int main(int argc, char ** argv){
+	uint32_t version = 1, num_inodes = 0, num_data_blocks = 0;
+	int fragment = 0, compress = 0;
+	const char * out = NULL;
+	int opt;
+	uint32_t i, j;
+
+	//every image starts with the directory itself and the rtc device
+	add_file(".", 1, NULL, 0, -1);
+	add_file("rtc", 0, NULL, 0, -1);
+
+	while ((opt = getopt(argc, argv, "12i:b:n:Fzo:")) != -1)
+	{
+		switch (opt)
+		{
+			case '1': version = 1; break;
+			case '2': version = FS_VERSION_2; break;
+			case 'i': num_inodes = strtoul(optarg, NULL, 0); break;
+			case 'b': num_data_blocks = strtoul(optarg, NULL, 0); break;
+			case 'F': fragment = 1; break;
+			case 'z': compress = 1; break;
+			case 'o': out = optarg; break;
+			case 'n':
+				if (add_generated(optarg) == -1)
+					usage(argv[0]);
+				break;
+			default: usage(argv[0]);
+		}
+	}
+	if (out == NULL || argc - optind > 1)
+		usage(argv[0]);
+	if (optind < argc && add_dir(argv[optind], -1, 0) == -1)
+		return 1;
+
+	//directory limits of the format
+	uint32_t max_dentries = (version == FS_VERSION_2) ? FS_MAX_DENTRIES_V2 : FS_MAX_DENTRIES;
+	uint32_t num_root = 0;
+	for (i = 0; i < num_files; i++)
+	{
+		if (files[i].parent == -1)
+			num_root++;
+		for (j = 0; j < i; j++)
+		{
+			if (files[i].parent == files[j].parent && strncmp(files[i].name, files[j].name, 32) == 0)
+			{
+				fprintf(stderr, "mkfs: duplicate name %.32s\n", files[i].name);
+				return 1;
+			}
+		}
+	}
+	if (num_root > max_dentries)
+	{
+		fprintf(stderr, "mkfs: %u entries, a v%u root directory holds %u\n", num_root, version, max_dentries);
+		return 1;
+	}
+
+	//inode 0 is shared by "." and "rtc" (and is the root directory inode),
+	//regular files and subdirectories take the inodes after it
+	uint32_t next_inode = 1;
+	for (i = 0; i < num_files; i++)
+		files[i].inode = (files[i].type == 2 || files[i].subdir) ? next_inode++ : 0;
+	if (num_inodes == 0)
+		num_inodes = next_inode;
+	if (num_inodes < next_inode || (version == FS_VERSION_2 && num_inodes > FS_MAX_INODES))
+	{
+		fprintf(stderr, "mkfs: %u inodes can't hold %u files\n", num_inodes, next_inode - 1);
+		return 1;
+	}
+
+	build_subdirs();
+	for (i = 0; i < num_files; i++)
+	{
+		if (version == 1 && files[i].num_blocks > FS_MAX_FILE_BLOCKS)
+		{
+			fprintf(stderr, "mkfs: %.32s needs %u blocks, a v1 inode holds %u\n", files[i].name, files[i].num_blocks, FS_MAX_FILE_BLOCKS);
+			return 1;
+		}
+	}
+
+	//v2 directory and extent blocks come first so all the metadata is at the
+	//start of the image (which a compressed image keeps uncompressed), then
+	//file data. Shifting the file data doesn't change its extent counts.
+	uint32_t dir_blocks = 0, inode_blocks = num_inodes, meta_blocks = 0;
+	if (version == FS_VERSION_2)
+	{
+		dir_blocks = (num_root + FS_DENTRIES_PER_BLOCK - 1) / FS_DENTRIES_PER_BLOCK;
+		inode_blocks = (num_inodes + FS_INODES_PER_BLOCK - 1) / FS_INODES_PER_BLOCK;
+	}
+	meta_blocks = dir_blocks;
+	place_blocks(dir_blocks, fragment);
+	uint32_t * extent_blocks = calloc(num_files, sizeof(uint32_t));
+	if (version == FS_VERSION_2)
+	{
+		for (i = 0; i < num_files; i++)
+		{
+			uint32_t extents = count_extents(&files[i]);
+			if (extents > FS_MAX_EXTENTS)
+			{
+				fprintf(stderr, "mkfs: %.32s needs %u extents, a v2 inode holds %u\n", files[i].name, extents, FS_MAX_EXTENTS);
+				return 1;
+			}
+			if (extents > FS_INLINE_EXTENTS)
+				extent_blocks[i] = meta_blocks++;
+		}
+	}
+	uint32_t used = place_blocks(meta_blocks, fragment);
+	if (num_data_blocks == 0)
+		num_data_blocks = used;
+	if (num_data_blocks < used || num_data_blocks > FS_MAX_DATA_BLOCKS)
+	{
+		fprintf(stderr, "mkfs: %u data blocks needed, %u requested (at most %u)\n", used, num_data_blocks, FS_MAX_DATA_BLOCKS);
+		return 1;
+	}
+
+	//lay out the image
+	uint32_t image_blocks = 1 + inode_blocks + num_data_blocks;
+	uint8_t * image = calloc(image_blocks, BLOCK);
+	uint8_t * data = image + ((1 + inode_blocks) * BLOCK);
+	superblock_t * sb = (superblock_t *)image;
+	disk_dentry_t * dentries = (disk_dentry_t *)(image + 64);
+
+	sb -> num_dentries = num_root;
+	sb -> num_inodes = num_inodes;
+	sb -> num_data_blocks = num_data_blocks;
+	if (version == FS_VERSION_2)
+	{
+		sb -> magic = FS_MAGIC;
+		sb -> version = FS_VERSION_2;
+		sb -> inode_blocks = inode_blocks;
+		sb -> root_inode = 0;
+		dentries = (disk_dentry_t *)data;
+
+		inode_v2_t * root = (inode_v2_t *)(image + BLOCK);
+		root -> length = num_root * FS_DENTRY_SIZE;
+		if (dir_blocks > 0)
+		{
+			root -> num_extents = 1;
+			root -> extents[0].start = 0;
+			root -> extents[0].count = dir_blocks;
+		}
+	}
+
+	uint32_t root_pos = 0;
+	for (i = 0; i < num_files; i++)
+	{
+		mkfs_file_t * file = &files[i];
+		if (file -> parent == -1)
+			put_dentry(&dentries[root_pos++], file -> name, file -> type, file -> inode);
+		if (file -> type != 2 && !file -> subdir)
+			continue;
+
+		for (j = 0; j < file -> num_blocks; j++)
+		{
+			uint32_t len = file -> length - (j * BLOCK);
+			if (len > BLOCK)
+				len = BLOCK;
+			memcpy(data + (file -> blocks[j] * BLOCK), file -> data + (j * BLOCK), len);
+		}
+
+		if (version == FS_VERSION_2)
+		{
+			inode_v2_t * node = (inode_v2_t *)(image + BLOCK) + file -> inode;
+			node -> length = file -> length;
+			write_extents(node, file, extent_blocks[i], data);
+		}
+		else
+		{
+			inode_t * node = (inode_t *)(image + ((file -> inode + 1) * BLOCK));
+			node -> length = file -> length;
+			memcpy(node -> data_blocks, file -> blocks, file -> num_blocks * sizeof(uint32_t));
+		}
+	}
+
+	FILE * img = fopen(out, "wb");
+	uint32_t size = image_blocks * BLOCK;
+	if (compress && img != NULL)
+		size = write_compressed(img, image, image_blocks, 1 + inode_blocks + meta_blocks);
+	else if (img != NULL && fwrite(image, BLOCK, image_blocks, img) != image_blocks)
+		size = 0;
+	if (img == NULL || size == 0)
+	{
+		perror(out);
+		return 1;
+	}
+	fclose(img);
+
+	printf("%s: v%u, %u entries (%u in the root directory), %u inodes, %u of %u data blocks used%s", out, version,
+		num_files, num_root, num_inodes, used, num_data_blocks, fragment ? ", fragmented" : "");
+	if (compress)
+		printf(", compressed %u -> %u bytes", image_blocks * BLOCK, size);
+	printf("\n");
+	return 0;
+}
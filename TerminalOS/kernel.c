@@ -10,6 +10,10 @@
 #include "keyboard.h"
 #include "terminal.h"
 #include "filesystem.h"
+#include "block_cache.h"
+#include "page_alloc.h"
+#include "vfs.h"
+#include "tmpfs.h"
 #include "rtc.h"
 #include "pit.h"
 #include "sys_calls.h"
@@ -21,6 +25,7 @@
 static void set_kernel_int_gate(uint8_t n, idt_desc_t * idt);
 static void set_user_int_gate(uint8_t n, idt_desc_t * idt);
 static void init_IDT();
+static void mount_modules(multiboot_info_t * mbi);
 
 unsigned int page_directory[1024] __attribute__((aligned (4096)));
 unsigned int first_page_table[1024] __attribute__((aligned (4096)));
@@ -175,7 +180,26 @@ entry (unsigned long magic, unsigned long addr)
 	terminal_init();
 	init_keyboard();
 	module_t* mod = (module_t*)mbi->mods_addr;
-	fs_init(mod->mod_start);
+	
+	//Free page frames, minus any the boot modules were loaded into
+	page_alloc_init(CHECK_FLAG(mbi->flags, 0) ? mbi->mem_upper : 0);
+	if (CHECK_FLAG(mbi->flags, 3))
+	{
+		uint32_t i;
+		for (i = 0; i < mbi->mods_count; i++)
+			page_reserve(mod[i].mod_start, mod[i].mod_end);
+	}
+	
+	bcache_init();
+	tmpfs_init();
+	
+	//The boot image holds every path outside the scratch files in tmp/ and
+	//the other modules' volumes. tmp is mounted first so a module can't
+	//take its name.
+	vfs_init();
+	if (vfs_mount("tmp", &tmpfs_vfs_ops, NULL) == -1)
+		printf("tmp couldn't be mounted\n");
+	mount_modules(mbi);
 	update_video_page_pointer(video_page_table);
 	
 	//Enable PIT interrupts
@@ -202,6 +226,13 @@ entry (unsigned long magic, unsigned long addr)
 		address += 0x400000;
 	}
 	
+	//the frame pool holds shared program pages, copy-on-write frames and
+	//scratch files, only the kernel may reach it through its identity map
+	for(i = PAGE_POOL_START >> 22; i < PAGE_POOL_END >> 22; i++)
+	{
+		page_directory[i] = (i << 22) | 0x83;
+	}
+	
 	address = 0;
 
 	//we will fill all 1024 entries, mapping first 4 megabytes
@@ -246,10 +277,11 @@ entry (unsigned long magic, unsigned long addr)
 	cr4 |= 0x00000010;
 	asm volatile("mov %0, %%cr4":: "b"(cr4));
 
-	//sets paging enable bit of cr0
+	//sets paging enable bit of cr0, and write protect so the kernel's
+	//writes to user buffers also copy copy-on-write pages
 	unsigned int cr0;
 	asm volatile("mov %%cr0, %0": "=b"(cr0));
-	cr0 |= 0x80000000;
+	cr0 |= 0x80010000;
 	asm volatile("mov %0, %%cr0":: "b"(cr0));
 
 	/* Enable interrupts */
@@ -272,6 +304,69 @@ entry (unsigned long magic, unsigned long addr)
 	asm volatile(".1: hlt; jmp .1;");
 }
 
+/*
+ * mount_modules
+ *   DESCRIPTION: Mounts every boot module as a file system volume. The first module is the
+ *      boot image and holds every path, the others are mounted under the second word of their
+ *      command line, or under their file name without its extension if there is none (a module
+ *      loaded as "/boot/data.img" is mounted at "data/").
+ *   INPUTS: mbi - multiboot information
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Prints the modules that couldn't be mounted
+ */
+static void mount_modules(multiboot_info_t * mbi)
+{
+	module_t * mod = (module_t *)mbi->mods_addr;
+	int8_t name[VFS_NAME_LEN];
+	uint32_t i, len;
+
+	if (!CHECK_FLAG(mbi->flags, 3))
+		return;
+
+	for (i = 0; i < mbi->mods_count; i++)
+	{
+		int8_t * cmd = (int8_t *)mod[i].string;
+		int8_t * start = cmd;
+		len = 0;
+
+		if (i != 0 && cmd != NULL)
+		{
+			//skip the path, then take the name after it
+			while (*cmd != '\0' && *cmd != ' ')
+			{
+				if (*cmd == '/')
+					start = cmd + 1;
+				cmd++;
+			}
+			while (*cmd == ' ')
+				cmd++;
+
+			if (*cmd != '\0')
+			{
+				while (cmd[len] != '\0' && cmd[len] != ' ' && len < VFS_NAME_LEN - 1)
+				{
+					name[len] = cmd[len];
+					len++;
+				}
+			}
+			else
+			{
+				while (start[len] != '\0' && start[len] != ' ' && start[len] != '.' && len < VFS_NAME_LEN - 1)
+				{
+					name[len] = start[len];
+					len++;
+				}
+			}
+		}
+		name[len] = '\0';
+
+		//a module without a name would take over the boot image's paths
+		if ((i != 0 && len == 0) || fs_mount(mod[i].mod_start, name) == -1)
+			printf("Module %d couldn't be mounted\n", i);
+	}
+}
+
 /*
  * set_kernel_int_gate
  *   DESCRIPTION: Sets up a Interrupt Gate entry in the IDT according to the format specified below,
@@ -565,20 +660,27 @@ void do_general_protection()
 
 /*
  * do_page_fault()
- *	PURPOSE: This is the page fault exception handler.
- *	INPUT: None
+ *	PURPOSE: This is the page fault exception handler. The first touch of a page of program memory
+ *		maps it, a write to a copy-on-write page copies it, any other fault prints its address
+ *		and stops.
+ *	INPUT: error_code - error code pushed by the processor, bit 0 is set for protection faults
+ *		on present pages and bit 1 for writes
  *	OUTPUT: Prints meaningful information to the screen. This is used primarily for debugging purposes and will
  *  	change once it is properly implemented.
  *	RETURN VALUE: None
- *	SIDE EFFECTS: None.
+ *	SIDE EFFECTS: Program memory pages may be mapped
  */
-void do_page_fault()
+void do_page_fault(uint32_t error_code)
 {
 	uint32_t fault_addr = 0x0;
 	asm volatile("movl %%cr2, %0"
 		:"=r"(fault_addr)
 		:
 	);
+	if ((error_code & 3) == 3 && copy_user_page(fault_addr) == 0)
+		return;
+	if (!(error_code & 1) && map_user_page(fault_addr) == 0)
+		return;
 	printf("Page fault addrs: %x.\n", fault_addr);
 	asm volatile(".17: hlt; jmp .17;");
 }
@@ -680,6 +782,9 @@ int do_pit()
 	//write high byte to channel 0 (0x40)
 	outb(0x00, 0x40);
 	
+	//read ahead file blocks queued since the last tick
+	bcache_run_prefetch();
+	
 	//jump to next process
 	int pid = get_next_process();
 	
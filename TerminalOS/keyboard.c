@@ -98,7 +98,7 @@ void print_scancode_to_terminal(uint16_t scancode)
 	
 	//Tell terminal to write character here
 	switch_to_active_terminal();
-	terminal_write(buf, 1);
+	terminal_write(NULL, buf, 1);
 	return_to_terminal();
 }
 /***************************************************************************/
@@ -0,0 +1,289 @@
+/* lz4.c
+ * LZ4 block format codec and the read-only block device over a compressed
+ * file system image. Blocks are decompressed only when the block cache
+ * misses on them, so the cache bounds how much of the image is expanded.
+ */
+
+#ifdef FS_HOST_TOOL
+#include <string.h>
+#endif
+
+#include "lz4.h"
+
+//Matches are at least 4 bytes, the last 5 bytes are always literals and
+//the last match starts at least 12 bytes before the end
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+
+//Compressor match finder slots (2^12)
+#define LZ4_HASH_BITS 12
+
+/***************************PRIVATE LZ4 FUNCTIONS************************************/
+
+/*
+ * read_length
+ *   DESCRIPTION:	Adds the extra length bytes following a token field of 15
+ *   INPUTS:		src     - compressed data
+ *					src_len - bytes in src
+ *					in      - position in src, moved past the length bytes
+ *					len     - field value, extended in place
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the data ends first
+ *   SIDE EFFECTS:	None
+ */
+static int32_t read_length(const uint8_t * src, uint32_t src_len, uint32_t * in, uint32_t * len){
+	uint8_t byte;
+
+	if (*len != 15)
+		return 0;
+	do
+	{
+		if (*in >= src_len)
+			return -1;
+		byte = src[(*in)++];
+		*len += byte;
+	} while (byte == 255);
+	return 0;
+}
+
+/************************************************************************************/
+
+/*
+ * lz4_decompress
+ *   DESCRIPTION:	Expands one LZ4 block (a series of literal run and match
+ *					sequences), checking every length and offset against the
+ *					buffers so a corrupt block can't write outside dest
+ *   INPUTS:		src      - compressed block
+ *					src_len  - bytes in src
+ *					dest     - buffer for the expanded data
+ *					dest_len - size of dest
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes expanded, -1 if the block is corrupt
+ *   SIDE EFFECTS:	dest is filled
+ */
+int32_t lz4_decompress(const uint8_t * src, uint32_t src_len, uint8_t * dest, uint32_t dest_len){
+	uint32_t in = 0, out = 0;
+
+	while (in < src_len)
+	{
+		uint8_t token = src[in++];
+
+		//literal run
+		uint32_t len = token >> 4;
+		if (read_length(src, src_len, &in, &len) == -1)
+			return -1;
+		if (len > src_len - in || len > dest_len - out)
+			return -1;
+		memcpy(dest + out, src + in, len);
+		in += len;
+		out += len;
+
+		//the last sequence has no match
+		if (in == src_len)
+			break;
+
+		//match, which may overlap what it copies
+		if (src_len - in < 2)
+			return -1;
+		uint32_t offset = src[in] | (src[in + 1] << 8);
+		in += 2;
+		if (offset == 0 || offset > out)
+			return -1;
+		len = token & 15;
+		if (read_length(src, src_len, &in, &len) == -1)
+			return -1;
+		len += LZ4_MIN_MATCH;
+		if (len > dest_len - out)
+			return -1;
+		while (len-- > 0)
+		{
+			dest[out] = dest[out - offset];
+			out++;
+		}
+	}
+	return out;
+}
+
+#ifdef FS_HOST_TOOL
+
+/*
+ * write_length
+ *   DESCRIPTION:	Stores the part of a length past 15 as extra length bytes
+ *   INPUTS:		dest - output buffer
+ *					out  - position in dest, moved past the bytes
+ *					len  - full length of the token field
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	dest changes
+ */
+static void write_length(uint8_t * dest, uint32_t * out, uint32_t len){
+	if (len < 15)
+		return;
+	len -= 15;
+	while (len >= 255)
+	{
+		dest[(*out)++] = 255;
+		len -= 255;
+	}
+	dest[(*out)++] = len;
+}
+
+/*
+ * write_sequence
+ *   DESCRIPTION:	Stores a literal run and, unless match_len is 0, a match
+ *   INPUTS:		dest      - output buffer
+ *					dest_len  - size of dest
+ *					out       - position in dest, moved past the sequence
+ *					literals  - literal bytes
+ *					lit_len   - number of literal bytes
+ *					offset    - distance back to the match
+ *					match_len - match length (0 for the last sequence)
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if dest is too small
+ *   SIDE EFFECTS:	dest changes
+ */
+static int32_t write_sequence(uint8_t * dest, uint32_t dest_len, uint32_t * out, const uint8_t * literals,
+	uint32_t lit_len, uint32_t offset, uint32_t match_len){
+	uint32_t ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+
+	//worst case size of the sequence
+	if (*out + 1 + (lit_len / 255 + 1) + lit_len + 2 + (ml / 255 + 1) > dest_len)
+		return -1;
+
+	dest[(*out)++] = ((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15);
+	write_length(dest, out, lit_len);
+	memcpy(dest + *out, literals, lit_len);
+	*out += lit_len;
+	if (match_len == 0)
+		return 0;
+
+	dest[(*out)++] = offset & 0xFF;
+	dest[(*out)++] = offset >> 8;
+	write_length(dest, out, ml);
+	return 0;
+}
+
+/*
+ * lz4_compress
+ *   DESCRIPTION:	Compresses data into one LZ4 block, finding matches with a
+ *					hash table of the last position each 4 byte string was seen
+ *   INPUTS:		src      - data to compress
+ *					src_len  - bytes in src
+ *					dest     - buffer for the block
+ *					dest_len - size of dest
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Size of the block, 0 if it doesn't fit in dest
+ *   SIDE EFFECTS:	dest is filled
+ */
+uint32_t lz4_compress(const uint8_t * src, uint32_t src_len, uint8_t * dest, uint32_t dest_len){
+	int32_t table[1 << LZ4_HASH_BITS];
+	uint32_t pos = 0, anchor = 0, out = 0;
+
+	memset(table, -1, sizeof(table));
+
+	while (src_len >= LZ4_MF_LIMIT && pos + LZ4_MF_LIMIT <= src_len)
+	{
+		uint32_t seq;
+		memcpy(&seq, src + pos, 4);
+		uint32_t hash = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+		int32_t candidate = table[hash];
+		table[hash] = pos;
+
+		if (candidate == -1 || pos - candidate > 0xFFFF || memcmp(src + candidate, src + pos, 4) != 0)
+		{
+			pos++;
+			continue;
+		}
+
+		//extend the match up to the literals that must end the block
+		uint32_t len = LZ4_MIN_MATCH;
+		while (pos + len < src_len - LZ4_LAST_LITERALS && src[candidate + len] == src[pos + len])
+			len++;
+
+		if (write_sequence(dest, dest_len, &out, src + anchor, pos - anchor, pos - candidate, len) == -1)
+			return 0;
+		pos += len;
+		anchor = pos;
+	}
+
+	if (write_sequence(dest, dest_len, &out, src + anchor, src_len - anchor, 0, 0) == -1)
+		return 0;
+	return out;
+}
+
+#else
+
+/***************************COMPRESSED IMAGE DEVICE**********************************/
+
+/*
+ * lz4disk_read_block
+ *   DESCRIPTION:	Copies a raw block of a compressed image or expands a
+ *					compressed one
+ *   INPUTS:		dev   - compressed image device
+ *					block - block number in the uncompressed image
+ *					buf   - 4KB buffer to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the block is past the image or corrupt
+ *   SIDE EFFECTS:	buf is filled
+ */
+static int32_t lz4disk_read_block(block_dev_t * dev, uint32_t block, uint8_t * buf){
+	lz4_header_t * header = (lz4_header_t *)dev -> base;
+
+	if (block >= header -> num_blocks)
+		return -1;
+	if (block < header -> raw_blocks)
+	{
+		memcpy(buf, (uint8_t *)(dev -> base + BLOCK_SIZE + (block * BLOCK_SIZE)), BLOCK_SIZE);
+		return 0;
+	}
+
+	uint32_t * table = (uint32_t *)(dev -> base + header -> table);
+	uint32_t start = table[block - header -> raw_blocks];
+	uint32_t len = table[block - header -> raw_blocks + 1] - start;
+	if (len == BLOCK_SIZE)
+	{
+		memcpy(buf, (uint8_t *)(dev -> base + start), BLOCK_SIZE);
+		return 0;
+	}
+	if (lz4_decompress((uint8_t *)(dev -> base + start), len, buf, BLOCK_SIZE) != BLOCK_SIZE)
+		return -1;
+	return 0;
+}
+
+/*
+ * lz4disk_write_block
+ *   DESCRIPTION:	Refuses writes, compressed images are read only
+ *   INPUTS:		dev, block, buf - ignored
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	-1
+ *   SIDE EFFECTS:	None
+ */
+static int32_t lz4disk_write_block(block_dev_t * dev, uint32_t block, const uint8_t * buf){
+	return -1;
+}
+
+/*
+ * lz4disk_init
+ *   DESCRIPTION:	Sets up a read only block device over a compressed image in
+ *					memory, such as a multiboot module
+ *   INPUTS:		dev  - block device to fill
+ *					base - address of the image's header
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if base doesn't hold a compressed image
+ *   SIDE EFFECTS:	None
+ */
+int32_t lz4disk_init(block_dev_t * dev, uint32_t base){
+	lz4_header_t * header = (lz4_header_t *)base;
+
+	if (header -> magic != LZ4_IMAGE_MAGIC || header -> raw_blocks == 0 || header -> raw_blocks > header -> num_blocks)
+		return -1;
+
+	dev -> num_blocks = header -> num_blocks;
+	dev -> read_block = &lz4disk_read_block;
+	dev -> write_block = &lz4disk_write_block;
+	dev -> base = base;
+	return 0;
+}
+
+#endif /* FS_HOST_TOOL */
@@ -0,0 +1,45 @@
+/* lz4.h
+ * Header for the LZ4 block codec and the compressed file system image
+ */
+
+#ifndef _LZ4_H
+#define _LZ4_H
+
+//Host tools (fstools/) build the compressor and use the image format
+#ifdef FS_HOST_TOOL
+#include <stdint.h>
+#else
+#include "types.h"
+#include "lib.h"
+#include "block_cache.h"
+#endif
+
+//Compressed image identification ("FSLZ")
+#define LZ4_IMAGE_MAGIC 0x5A4C5346
+
+//Size of an image block before compression
+#define LZ4_BLOCK_SIZE 4096
+
+//Header in the first 4KB of a compressed image. It is followed by raw_blocks
+//uncompressed blocks (the start of the image, so its boot block, inodes and
+//other metadata can be used in place), then at byte offset table by
+//num_blocks - raw_blocks + 1 byte offsets of the compressed blocks, the last
+//one being the end of the image. A block stored in LZ4_BLOCK_SIZE bytes
+//wasn't compressible and is kept as is.
+typedef struct lz4_header{
+	uint32_t magic;
+	uint32_t num_blocks;	//blocks of the uncompressed image
+	uint32_t raw_blocks;	//leading blocks stored uncompressed after the header
+	uint32_t table;			//byte offset of the block offset table
+	uint32_t reserved[12];
+}lz4_header_t;
+
+int32_t lz4_decompress(const uint8_t * src, uint32_t src_len, uint8_t * dest, uint32_t dest_len);
+
+#ifdef FS_HOST_TOOL
+uint32_t lz4_compress(const uint8_t * src, uint32_t src_len, uint8_t * dest, uint32_t dest_len);
+#else
+int32_t lz4disk_init(block_dev_t * dev, uint32_t base);
+#endif
+
+#endif /* _LZ4_H */
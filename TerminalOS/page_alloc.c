@@ -0,0 +1,214 @@
+/* page_alloc.c
+ * Physical page frame allocator. Free 4KB frames of the pool are tracked
+ * in a bitmap, and the pool is identity mapped by the kernel's 4MB pages
+ * so a frame's physical address can be used as a pointer to it.
+ */
+
+#include "page_alloc.h"
+
+/***************************PAGE ALLOCATOR GLOBAL VARIABLES**************************/
+
+//One bit per frame of the pool, set if the frame is in use
+uint32_t page_bitmap[PAGE_POOL_FRAMES / 32];
+
+//References to each allocated frame, for frames shared by page tables
+uint16_t page_refs[PAGE_POOL_FRAMES];
+
+//Frames backed by memory, and the bitmap word a search starts at
+uint32_t page_limit = 0;
+uint32_t page_next = 0;
+
+//Allocator counters
+page_alloc_stats_t page_stats;
+
+/************************************************************************************/
+
+/*
+ * page_alloc_init
+ *   DESCRIPTION:	Marks every frame of the pool that is backed by memory free
+ *   INPUTS:		mem_upper - KB of memory above 1MB (from multiboot), 0 if
+ *							unknown
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Clears the bitmap and counters
+ */
+void page_alloc_init(uint32_t mem_upper){
+	uint32_t mem_end = PAGE_POOL_END;
+	uint32_t i;
+
+	if (mem_upper != 0 && mem_upper < (PAGE_POOL_END >> 10) - 1024)
+		mem_end = (mem_upper + 1024) << 10;
+	if (mem_end < PAGE_POOL_START)
+		mem_end = PAGE_POOL_START;
+
+	page_limit = (mem_end - PAGE_POOL_START) / PAGE_SIZE;
+	page_next = 0;
+	memset(&page_stats, 0, sizeof(page_stats));
+	memset(page_bitmap, 0, sizeof(page_bitmap));
+	memset(page_refs, 0, sizeof(page_refs));
+
+	//frames without memory behind them are never handed out
+	for (i = page_limit; i < PAGE_POOL_FRAMES; i++)
+		page_bitmap[i / 32] |= 1 << (i % 32);
+
+	page_stats.total = page_limit;
+	page_stats.free = page_limit;
+}
+
+/*
+ * page_reserve
+ *   DESCRIPTION:	Takes memory the pool overlaps, such as a multiboot module,
+ *					out of the pool
+ *   INPUTS:		start - first byte
+ *					end   - byte past the last one
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Frames holding any of the bytes are marked in use
+ */
+void page_reserve(uint32_t start, uint32_t end){
+	uint32_t i;
+
+	if (end <= PAGE_POOL_START || start >= PAGE_POOL_END || end <= start)
+		return;
+	if (start < PAGE_POOL_START)
+		start = PAGE_POOL_START;
+	if (end > PAGE_POOL_END)
+		end = PAGE_POOL_END;
+
+	for (i = (start - PAGE_POOL_START) / PAGE_SIZE; i < (end - PAGE_POOL_START + PAGE_SIZE - 1) / PAGE_SIZE; i++)
+	{
+		if (i < page_limit && !(page_bitmap[i / 32] & (1 << (i % 32))))
+			page_stats.free--;
+		page_bitmap[i / 32] |= 1 << (i % 32);
+	}
+}
+
+/*
+ * page_alloc
+ *   DESCRIPTION:	Takes a free frame, skipping full bitmap words 32 frames
+ *					at a time
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Physical (and kernel) address of the frame, 0 if none is free
+ *   SIDE EFFECTS:	The frame isn't zeroed, it starts with one reference
+ */
+uint32_t page_alloc(){
+	uint32_t words = (page_limit + 31) / 32;
+	uint32_t i, bit;
+
+	for (i = 0; i < words; i++)
+	{
+		uint32_t word = (page_next + i) % words;
+		if (page_bitmap[word] == 0xFFFFFFFF)
+			continue;
+
+		for (bit = 0; page_bitmap[word] & (1 << bit); bit++)
+			;
+		page_bitmap[word] |= 1 << bit;
+		page_refs[word * 32 + bit] = 1;
+		page_next = word;
+		page_stats.free--;
+		page_stats.allocs++;
+		return PAGE_POOL_START + ((word * 32 + bit) * PAGE_SIZE);
+	}
+
+	page_stats.failures++;
+	return 0;
+}
+
+/*
+ * page_free
+ *   DESCRIPTION:	Returns a frame from page_alloc to the pool
+ *   INPUTS:		frame - address of the frame
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Addresses outside the pool and free frames are ignored,
+ *					other references to the frame are dropped
+ */
+void page_free(uint32_t frame){
+	if (frame < PAGE_POOL_START || frame >= PAGE_POOL_END)
+		return;
+
+	uint32_t i = (frame - PAGE_POOL_START) / PAGE_SIZE;
+	if (i >= page_limit || !(page_bitmap[i / 32] & (1 << (i % 32))))
+		return;
+
+	page_bitmap[i / 32] &= ~(1 << (i % 32));
+	page_refs[i] = 0;
+	page_stats.free++;
+	page_stats.frees++;
+}
+
+/*
+ * page_ref
+ *   DESCRIPTION:	Adds a reference to an allocated frame
+ *   INPUTS:		frame - address of the frame
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Addresses outside the pool and free frames are ignored
+ */
+void page_ref(uint32_t frame){
+	uint32_t i = (frame - PAGE_POOL_START) / PAGE_SIZE;
+	if (frame < PAGE_POOL_START || frame >= PAGE_POOL_END || page_refs[i] == 0)
+		return;
+	page_refs[i]++;
+}
+
+/*
+ * page_unref
+ *   DESCRIPTION:	Drops a reference to an allocated frame, freeing it with
+ *					its last reference
+ *   INPUTS:		frame - address of the frame
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Addresses outside the pool and free frames are ignored
+ */
+void page_unref(uint32_t frame){
+	uint32_t i = (frame - PAGE_POOL_START) / PAGE_SIZE;
+	if (frame < PAGE_POOL_START || frame >= PAGE_POOL_END || page_refs[i] == 0)
+		return;
+	if (--page_refs[i] == 0)
+		page_free(frame);
+}
+
+/*
+ * page_ref_count
+ *   DESCRIPTION:	Counts the references to a frame
+ *   INPUTS:		frame - address of the frame
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	References, 0 for free frames and addresses outside the pool
+ *   SIDE EFFECTS:	None
+ */
+uint32_t page_ref_count(uint32_t frame){
+	if (frame < PAGE_POOL_START || frame >= PAGE_POOL_END)
+		return 0;
+	return page_refs[(frame - PAGE_POOL_START) / PAGE_SIZE];
+}
+
+/*
+ * page_get_stats
+ *   DESCRIPTION:	Copies the allocator counters
+ *   INPUTS:		stats - structure to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+void page_get_stats(page_alloc_stats_t * stats){
+	*stats = page_stats;
+}
+
+/*
+ * print_page_stats
+ *   DESCRIPTION:	Prints the allocator counters
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Writes to the screen
+ */
+void print_page_stats(){
+	printf("\nframes    : %d", page_stats.total);
+	printf("\nfree      : %d", page_stats.free);
+	printf("\nallocs    : %d", page_stats.allocs);
+	printf("\nfrees     : %d", page_stats.frees);
+	printf("\nfailures  : %d\n", page_stats.failures);
+}
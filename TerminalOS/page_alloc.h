@@ -0,0 +1,39 @@
+/* page_alloc.h
+ * Header for the physical page frame allocator
+ */
+
+#ifndef _PAGE_ALLOC_H
+#define _PAGE_ALLOC_H
+
+#include "types.h"
+#include "lib.h"
+
+#define PAGE_SIZE 4096
+
+//Frames are handed out from physical memory above the process pages
+//(8MB - 32MB) and below the user program and file mapping pages at 128MB,
+//which shadow the identity mapping of that memory
+#define PAGE_POOL_START 0x02000000
+#define PAGE_POOL_END 0x08000000
+#define PAGE_POOL_FRAMES ((PAGE_POOL_END - PAGE_POOL_START) / PAGE_SIZE)
+
+//Allocator counters
+typedef struct page_alloc_stats{
+	uint32_t total;		//frames in the pool
+	uint32_t free;		//frames not allocated or reserved
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t failures;	//allocations with no free frame
+}page_alloc_stats_t;
+
+void page_alloc_init(uint32_t mem_upper);
+void page_reserve(uint32_t start, uint32_t end);
+uint32_t page_alloc();
+void page_free(uint32_t frame);
+void page_ref(uint32_t frame);
+void page_unref(uint32_t frame);
+uint32_t page_ref_count(uint32_t frame);
+void page_get_stats(page_alloc_stats_t * stats);
+void print_page_stats();
+
+#endif /* _PAGE_ALLOC_H */
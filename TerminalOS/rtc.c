@@ -157,12 +157,12 @@ void rtc_init()
  *   DESCRIPTION: 	Turns on the rtc and sets the frequency to 2Hz.
  *					Frequency is set using the change_RTC_freq function.
  *					Frequency is set to 2 Hz as specified.
- *   INPUTS: None
+ *   INPUTS: file - open file; not used in the function
  *   OUTPUTS: Sets the RTC frequency to 2 Hz (minimum accepted frequency)
  *   RETURN VALUE: 0
  *   SIDE EFFECTS: Enables RTC interrupts to occur.
  */
-int32_t rtc_open()
+int32_t rtc_open(file_t * file)
 {
     cli();
 	
@@ -202,13 +202,13 @@ int32_t rtc_open()
  *					rtc_interrupt_occured and sets it to 1. When this 
  *					happens, rtc_interrupt_occured is set to 0 again and
  *					returns. 
- *   INPUTS: 		Takes in a pointer to a buffer and the number of bytes in the
- *					buffer, but neither input is used in the function. 
+ *   INPUTS: 		Takes in the open file, a pointer to a buffer and the number of
+ *					bytes in the buffer, but no input is used in the function. 
  *   OUTPUTS: None
  *   RETURN VALUE: 0
  *   SIDE EFFECTS: None
  */
-int32_t rtc_read(void * buf, int32_t nbytes)
+int32_t rtc_read(file_t * file, void * buf, int32_t nbytes)
 {	
 	if (virtual_rtc[current_rtc].freq == 0)
 		return 0;
@@ -238,7 +238,8 @@ int32_t rtc_read(void * buf, int32_t nbytes)
 /*
  * rtc_write
  *   DESCRIPTION: 	Changes RTC frequency to whatever is passed in the buffer
- *   INPUTS:		const void * buf - 	pointer to a buffer (which contains the 
+ *   INPUTS:		file_t * file    - 	open file; not used in the function
+ *					const void * buf - 	pointer to a buffer (which contains the 
  *										desired frequency in Hz), 
  *					int32_t nbytes   - 	Max number of bytes to put in the buffer
  *   OUTPUTS: 		None
@@ -246,7 +247,7 @@ int32_t rtc_read(void * buf, int32_t nbytes)
  *					return -1 on failure.
  *   SIDE EFFECTS: 	None
  */
-int32_t rtc_write(const void* buf, int32_t nbytes)
+int32_t rtc_write(file_t * file, const void* buf, int32_t nbytes)
 {
 	//sti();
 	cli();
@@ -276,14 +277,41 @@ int32_t rtc_write(const void* buf, int32_t nbytes)
  * rtc_close
  *   DESCRIPTION: 	Turns off the RTC interrupts by setting
  *					the RTC frequency to 0.
- *   INPUTS: 		int32_t fd - File descriptor; not used in the function
+ *   INPUTS: 		file_t * file - open file; not used in the function
  *   RETURN VALUE: 	0
  *   SIDE EFFECTS: 	Modifies the frequency of RTC interrupts
  *					(effectively disables it).
  */
-int32_t rtc_close(int32_t fd)
+int32_t rtc_close(file_t * file)
 {
     /*Settting frequency to 0 turns off RTC*/
     change_RTC_freq(0);
 	return 0;
 }
+
+/*
+ * rtc_ioctl
+ *   DESCRIPTION: 	Fills a stat_t for the RTC's directory entry, the RTC
+ *					has no other ioctls
+ *   INPUTS: 		file_t * file - open RTC
+ *					uint32_t cmd  - ioctl command
+ *					uint32_t arg  - stat_t * for FIOC_STAT
+ *   RETURN VALUE: 	0 on success, -1 on failure or for other commands
+ *   SIDE EFFECTS: 	None
+ */
+int32_t rtc_ioctl(file_t * file, uint32_t cmd, uint32_t arg)
+{
+	if(cmd != FIOC_STAT)
+		return -1;
+	return fs_stat(&file -> f_dentry, (stat_t *)arg);
+}
+
+//Operations of an open RTC
+const file_operations_t rtc_fops = {
+	.open = &rtc_open,
+	.read = &rtc_read,
+	.write = &rtc_write,
+	.close = &rtc_close,
+	.seek = NULL,
+	.ioctl = &rtc_ioctl
+};
@@ -3,6 +3,7 @@
 
 #include "lib.h"
 #include "types.h"
+#include "filesystem.h"
 
 typedef struct virtual_rtc{
 	volatile float counter;	//Keeps track of the ticks
@@ -13,10 +14,14 @@ void tick();
 void change_to_virtual_rtc(int pid);
 
 void rtc_init();
-int32_t rtc_open();
-int32_t rtc_read(void* buf, int32_t nbytes);
-int32_t rtc_write(const void* buf, int32_t nbytes);
-int32_t rtc_close(int32_t fd);
+int32_t rtc_open(file_t * file);
+int32_t rtc_read(file_t * file, void* buf, int32_t nbytes);
+int32_t rtc_write(file_t * file, const void* buf, int32_t nbytes);
+int32_t rtc_close(file_t * file);
+int32_t rtc_ioctl(file_t * file, uint32_t cmd, uint32_t arg);
+
+//Operations of an open RTC
+extern const file_operations_t rtc_fops;
 
 void change_RTC_freq(uint32_t freq);
 
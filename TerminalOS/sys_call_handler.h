@@ -9,6 +9,7 @@
 
 #ifndef ASM
 extern int32_t sys_call_handler();
+extern void fork_child_return();
 
 #endif
 #endif
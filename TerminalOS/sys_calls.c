@@ -11,8 +11,17 @@
 #include "rtc.h"
 #include "terminal.h"
 #include "directory.h"
+#include "vfs.h"
+#include "page_alloc.h"
+#include "sys_call_handler.h"
 
 
+#define USER_START	0x08000000	//128MB virtual, the program's 4MB of memory
+#define MMAP_START	0x08400000	//132MB virtual, where files are mapped
+#define PTE_COW		0x200		//available page table entry bit, page is copied on its first write
+#define SYS_CALL_FRAME	80		//bytes sys_call_handler keeps at the top of the kernel stack
+#define MMAP_PAGES	1024		//4KB pages in the mapping area
+
 //local pointers to important memory locations
 unsigned int * page_dir;
 pcb_t * current_pcb = 0x0;
@@ -26,9 +35,17 @@ int active_terminals[4] = {0,0,0,0};
 int cur_terminal = 0;
 int cur_process = 1;
 int sched_on = 0;
+int mapped_pid = 0;
 uint32_t* t_esp;
 unsigned int * video_pg_table;
 
+//Page tables of each process's file mappings at 132MB (indexed by pid - 1)
+unsigned int mmap_page_tables[6][1024] __attribute__((aligned (4096)));
+
+//Page tables of each process's program memory at 128MB (indexed by pid - 1),
+//pages are only mapped when they are first touched
+unsigned int user_page_tables[6][1024] __attribute__((aligned (4096)));
+
 
 /*
  * halt
@@ -66,10 +83,50 @@ int32_t halt (uint8_t status){
 		}		
 	}
 	
+	//Close the files left open, scratch files may be waiting on their last close
+	int fd;
+	for(fd = 2; fd < 8; fd++){
+		if(used_desc[fd] == 1){
+			close(fd);
+		}
+	}
+	
+	//Free the process's memory
+	clear_mmap(current_pcb -> pid);
+	clear_user_pages(current_pcb -> pid);
+	
+	//Nobody collects the children left now, free the ones done
+	orphan_children(current_pcb -> pid);
+	
+	//A spawned or forked process has no parent to return to. It keeps its
+	//pid until the parent collects its status with waitpid, and another
+	//process of its terminal runs instead.
+	if(current_pcb -> detached){
+		int term = current_pcb -> terminal_id;
+		int pid = current_pcb -> pid;
+		
+		copy_video_mem_out(term);
+		update_screen_x_y(current_pcb);
+		if(current_pcb -> parent_pid != 0){
+			current_pcb -> exit_status = status;
+			current_pcb -> exited = 1;
+			
+			//wake the parent if it is in waitpid
+			if(current_pcb -> parent_pcb -> waiting){
+				current_pcb -> parent_pcb -> waiting = 0;
+				current_pcb -> parent_pcb -> blocked = 0;
+			}
+		}
+		else{
+			free_process(pid);
+		}
+		
+		active_process[term] = next_runnable(term, pid);
+		jump_to_process(active_process[term]);
+	}
+	
 	//Change Paging back to parent process
-	page_dir[32] = (0x800000 + (0x400000 * (current_pcb -> parent_pid -1))) | 0x87; //0x00800087;
-	//Clear Buffer
-	asm volatile("mov %0, %%cr3":: "b"(page_dir));
+	map_process_pages(current_pcb -> parent_pid);
 	tss.esp0 = current_pcb -> parent_esp;   //((uint32_t *)current_pcb)[5];//(uint32_t)((uint8_t *)parent_process + 8192);
 	
 	//Push ebp,esp(both are done in execute), and status(the return value)
@@ -82,6 +139,7 @@ int32_t halt (uint8_t status){
 	update_screen_x_y(current_pcb);
 	update_parent_video(current_pcb);
 	active_process[current_pcb -> terminal_id] = current_pcb -> parent_pid;
+	current_pcb -> parent_pcb -> blocked = 0;
 	open_pid[(current_pcb -> pid)-1] = 0;   //free pid for another process's use
 	clear_pcb(current_pcb -> pid);
 	
@@ -100,30 +158,16 @@ int32_t halt (uint8_t status){
 }
 
 /*
- * execute
- *	FUNCTION:	  Executes given command in a new process if it is a valid executable.
- *				  Switches to user mode to execute command.
- *	INTPUT: 	  uint8_t * command - String command to run, including space separated 
- *				 					  arguments
+ * split_command
+ *	FUNCTION:	  Splits a command into the program name and its arguments
+ *	INTPUT: 	  com  - command, cut after the program name
+ *				  args - filled with the arguments, holds as many bytes as
+ *						 the command
  *	OUTPUT: 	  None
- *	RETURN VALUE: Returns the status when process is ended
- *	SIDE EFFECTS: Jumps to user mode
+ *	RETURN VALUE: None
+ *	SIDE EFFECTS: None
  */
-int32_t execute (const uint8_t* command){
-	cli();
-	if(num_process > 6){
-		printf("No more processes can be run.\n");
-		return 0;
-	}
-	
-	uint32_t k_esp, esp, eip, k_ebp, ss, cs, ds;
-
-	//local variable to hold command
-	int8_t com[strlen((int8_t *)command)];
-	strcpy(com, (int8_t *)command);
-	
-	//Split command and arguments
-	int8_t args[strlen(com)];
+void split_command(int8_t* com, int8_t* args){
 	int i;
 	int argsStarted = 0;
 	int len = strlen(com) + 1;
@@ -146,36 +190,88 @@ int32_t execute (const uint8_t* command){
 		//No arguments
 		args[0] = '\0';
 	}
+}
+
+/*
+ * load_command
+ *	FUNCTION:	  Splits a command into the program and its arguments and sets
+ *				  the program up in a new process
+ *	INTPUT: 	  command - program name, then space separated arguments
+ *				  args    - filled with the arguments, holds as many bytes
+ *							as the command
+ *				  esp     - filled with the program's initial stack pointer
+ *				  eip     - filled with the program's entry point
+ *	OUTPUT: 	  None
+ *	RETURN VALUE: The new process's pcb, NULL if the command isn't a program
+ *				  or every pid is taken
+ *	SIDE EFFECTS: The pid is taken, the process's user memory is emptied
+ */
+pcb_t * load_command(const uint8_t* command, int8_t* args, uint32_t* esp, uint32_t* eip){
+	//local variable to hold command
+	int8_t com[strlen((int8_t *)command) + 1];
+	strcpy(com, (int8_t *)command);
+	split_command(com, args);
 	
 	//only load if program is valid and executable
 	dentry_t executable;
 	if(is_valid_cmd(&executable, (uint8_t *)com)== -1){
-		return -1;
+		return NULL;
 	}
 
 	int pid_pos=0;
-	while(open_pid[pid_pos] == 1){
+	while(pid_pos < 6 && open_pid[pid_pos] == 1){
 		pid_pos++;
 	}
+	if(pid_pos == 6){
+		return NULL;
+	}
 	open_pid[pid_pos] = 1;  //pid is now taken by new process
 	pid_pos++;              //new process's pid is pid_pos + 1
 	
-	//test if this is not first process, need to update page directory
-	if(current_pcb != 0x0)
-	{
-		page_dir[32] = (0x800000 + (0x400000 * (pid_pos-1))) | 0x87;  //0x00C00087;
-		asm volatile("mov %0, %%cr3":: "b"(page_dir));
-	}
+	//a new process has no mappings to release
+	get_pcb(pid_pos) -> num_mmaps = 0;
+	clear_mmap(pid_pos);
+	clear_user_pages(pid_pos);
 	
 	//Load Program into memory
-	pcb_t * pcb = load_program((uint8_t *)com, &esp, &eip, pid_pos);
+	pcb_t * pcb = load_program((uint8_t *)com, esp, eip, pid_pos);
 	if (pcb == NULL)
 	{
-		//Max tasks reached or no such command
+		//no such command
 		open_pid[--pid_pos] = 0;
+		return NULL;
+	}
+	return pcb;
+}
+
+/*
+ * execute
+ *	FUNCTION:	  Executes given command in a new process if it is a valid executable.
+ *				  Switches to user mode to execute command.
+ *	INTPUT: 	  uint8_t * command - String command to run, including space separated 
+ *				 					  arguments
+ *	OUTPUT: 	  None
+ *	RETURN VALUE: Returns the status when process is ended
+ *	SIDE EFFECTS: Jumps to user mode
+ */
+int32_t execute (const uint8_t* command){
+	cli();
+	if(num_process > 6){
+		printf("No more processes can be run.\n");
+		return 0;
+	}
+	
+	uint32_t k_esp, esp, eip, k_ebp, ss, cs, ds;
+
+	int8_t args[strlen((int8_t *)command) + 1];
+	pcb_t * pcb = load_command(command, args, &esp, &eip);
+	if(pcb == NULL){
 		return -1;
 	}
 	
+	//update page directory to the new process's memory
+	map_process_pages(pcb -> pid);
+	
 	pcb -> terminal_id = cur_terminal;
 	
 	if(open_terminals[cur_terminal] == 0){
@@ -196,20 +292,27 @@ int32_t execute (const uint8_t* command){
 		pcb -> parent_pcb = 0x0;
 	}
 	
+	//the caller waits here until the program halts, unless it's starting
+	//another terminal's first shell
+	pcb -> blocked = 0;
+	pcb -> detached = 0;
+	pcb -> exited = 0;
+	pcb -> waiting = 0;
+	if(current_pcb != NULL && pcb -> pid != open_terminals[cur_terminal]){
+		current_pcb -> blocked = 1;
+	}
+	
 	update_cur_pcb(pcb);
 	
 	//update virtual rtc
 	change_to_virtual_rtc(pcb->pid);
 
 	//stdin
-	pcb -> file_array[0].f_ops.open = &terminal_open;
-	pcb -> file_array[0].f_ops.read = &terminal_read;
-	pcb -> file_array[0].f_ops.write = NULL;
+	pcb -> file_array[0].f_ops = &terminal_stdin_fops;
 	pcb -> used_desc[0] = 1;
 	
 	//std out
-	pcb -> file_array[1].f_ops.read = NULL;
-	pcb -> file_array[1].f_ops.write = &terminal_write;
+	pcb -> file_array[1].f_ops = &terminal_stdout_fops;
 	pcb -> used_desc[1] = 1;
 	
 	//clear remaining file array positions
@@ -284,6 +387,207 @@ int32_t execute (const uint8_t* command){
 	return retval;
 }
 
+/*
+ * exec
+ *	FUNCTION:	  Replaces the caller's program with a command. The process
+ *				  keeps its pid, pcb, kernel stack and open files, except
+ *				  the ones marked close-on-exec, and starts the program
+ *				  with empty memory.
+ *	INTPUT: 	  uint8_t * command - String command to run, including space
+ *									  separated arguments
+ *	OUTPUT: 	  None
+ *	RETURN VALUE: Doesn't return on success, -1 if the command isn't a
+ *				  program, in which case the caller keeps running
+ *	SIDE EFFECTS: Jumps to user mode
+ */
+int32_t exec (const uint8_t* command){
+	cli();
+	if(current_pcb == NULL){
+		return -1;
+	}
+	
+	uint32_t esp, eip, ss, cs, ds;
+	
+	//the command is in the memory about to be freed
+	int8_t com[strlen((int8_t *)command) + 1];
+	int8_t args[strlen((int8_t *)command) + 1];
+	strcpy(com, (int8_t *)command);
+	split_command(com, args);
+	
+	//the old program is only dropped once the new one is read
+	if(load_program((uint8_t *)com, &esp, &eip, current_pcb -> pid) == NULL){
+		return -1;
+	}
+	
+	int fd;
+	for(fd = 2; fd < 8; fd++){
+		if(used_desc[fd] == 1 && file_array[fd].f_cloexec){
+			close(fd);
+		}
+	}
+	
+	clear_mmap(current_pcb -> pid);
+	clear_user_pages(current_pcb -> pid);
+	map_process_pages(current_pcb -> pid);
+	
+	strncpy(current_pcb -> args, args, ARGS_MAX - 1);
+	current_pcb -> args[ARGS_MAX - 1] = '\0';
+	
+	ss = USER_DS;
+	cs = USER_CS;
+	ds = USER_DS;
+	
+	//start over at the top of the kernel stack on the next system call
+	tss.esp0 = (uint32_t)((uint8_t *)current_pcb + 8192);
+	tss.ss0 = KERNEL_DS;
+	
+	int flag;
+	asm volatile("pushfl\n\t"
+				 "popl %%edx\n\t"
+				 "orl $0x200, %%edx\n\t"
+				 "movl %%edx, %0\n\t"
+				 :"=r"(flag)
+	);
+	
+	//execute program
+	asm volatile("pushl %0\n\t"
+				"pushl %1\n\t"
+				"pushl %5\n\t"
+				"pushl %2\n\t"
+				"pushl %3\n\t"
+				"movl %4, %%ds\n\t"
+				"movl %4, %%es\n\t"
+				"movl %1, %%ebp\n\t"
+				"iret"
+				: 
+				: "r" (ss), "r"(esp), "r"(cs), "r"(eip), "r"(ds), "r"(flag)
+	);
+	
+	return -1;
+}
+
+/*
+ * spawn
+ *	FUNCTION:	  Starts a command in a new process of the caller's terminal
+ *				  without waiting for it. The scheduler runs it alongside
+ *				  the caller, which collects its exit status with waitpid.
+ *	INTPUT: 	  uint8_t * command - String command to run, including space
+ *									  separated arguments
+ *	OUTPUT: 	  None
+ *	RETURN VALUE: The child's pid, -1 if the command isn't a program or no
+ *				  more processes can be run
+ *	SIDE EFFECTS: None
+ */
+int32_t spawn (const uint8_t* command){
+	cli();
+	if(current_pcb == NULL || num_process > 6){
+		return -1;
+	}
+	
+	uint32_t esp, eip;
+	int8_t args[strlen((int8_t *)command) + 1];
+	pcb_t * pcb = load_command(command, args, &esp, &eip);
+	if(pcb == NULL){
+		return -1;
+	}
+	
+	pcb -> terminal_id = current_pcb -> terminal_id;
+	pcb -> parent_pid = current_pcb -> pid;
+	pcb -> parent_pcb = current_pcb;
+	pcb -> blocked = 0;
+	pcb -> detached = 1;
+	pcb -> exited = 0;
+	pcb -> waiting = 0;
+	pcb -> k_esp = 0;
+	pcb -> k_ebp = 0;
+	
+	//empty terminal read state, printing continues where the caller is
+	pcb -> read_pos = 0;
+	pcb -> isReading = 0;
+	pcb -> terminal_pos = 0;
+	pcb -> enter_pressed = 0;
+	pcb -> clear_was_pressed = 0;
+	update_screen_x_y(current_pcb);
+	
+	//stdin and stdout only
+	pcb -> file_array[0].f_ops = &terminal_stdin_fops;
+	pcb -> used_desc[0] = 1;
+	pcb -> file_array[1].f_ops = &terminal_stdout_fops;
+	pcb -> used_desc[1] = 1;
+	int pos;
+	for(pos=2; pos<8; pos++){
+		pcb -> used_desc[pos] = 0;
+	}
+	
+	strncpy(pcb -> args, args, ARGS_MAX - 1);
+	pcb -> args[ARGS_MAX - 1] = '\0';
+	
+	//the scheduler starts it in user mode at the program's entry point
+	pcb -> ret_eip = eip;
+	pcb -> ret_cs = USER_CS;
+	pcb -> ret_flags = 0x202;
+	pcb -> ret_esp = esp;
+	pcb -> ret_ebp = esp;
+	
+	num_process++;
+	return pcb -> pid;
+}
+
+/*
+ * waitpid
+ *	FUNCTION:	  Collects the exit status of a child made by spawn or fork
+ *				  once it has halted, freeing its pid
+ *	INTPUT: 	  pid    - child to wait for, -1 for any child
+ *				  status - filled with the child's halt status if not NULL
+ *				  flags  - WNOHANG to return right away if the child is
+ *						   still running
+ *	OUTPUT: 	  None
+ *	RETURN VALUE: The pid of the collected child, 0 if WNOHANG was given
+ *				  and no child has halted, -1 if there is no such child
+ *	SIDE EFFECTS: Blocks the caller until a child halts
+ */
+int32_t waitpid (int32_t pid, int32_t* status, int32_t flags){
+	int i, found;
+	
+	if(status != NULL && check_user_buffer(status, sizeof(int32_t)) == -1){
+		return -1;
+	}
+	
+	while(1){
+		cli();
+		found = 0;
+		for(i = 1; i <= 6; i++){
+			pcb_t * child = get_pcb(i);
+			if(open_pid[i-1] != 1 || !child -> detached || child -> parent_pid != current_pcb -> pid || (pid != -1 && pid != i)){
+				continue;
+			}
+			found = 1;
+			if(child -> exited){
+				if(status != NULL){
+					*status = child -> exit_status;
+				}
+				free_process(i);
+				return i;
+			}
+		}
+		
+		if(!found){
+			return -1;
+		}
+		if(flags & WNOHANG){
+			return 0;
+		}
+		
+		//sleep until a child halts, the scheduler skips blocked processes
+		current_pcb -> waiting = 1;
+		current_pcb -> blocked = 1;
+		sti();
+		while(current_pcb -> blocked){
+			asm volatile("hlt");
+		}
+	}
+}
+
 /*
  * read
  *	FUNCTION:		Executes file's specific read driver function
@@ -295,57 +599,53 @@ int32_t execute (const uint8_t* command){
  *	SIDE EFFECTS:	Fills the buffer that was passed in
  */
 int32_t read (int32_t fd, void* buf, int32_t nbytes){
-	//bad file descriptor
-	if(fd < 0 || fd > 7){
+	//bad file descriptor, or the file can't be read
+	if(fd < 0 || fd > 7 || used_desc[fd] != 1 || file_array[fd].f_ops -> read == NULL){
 		return -1;
 	}
-	//regular file, need special buffer setup for fs_read()
-	if(file_array[fd].f_dentry.file_type == 2){
-		//check if file read
-		if (file_array[fd].eof == 1)
-		{
-			return 0;
-		}
-		
-		int bytes_read;
-		
-		if (nbytes < 12)
-		{
-			uint32_t buffer[3];
-			buffer[0] = 1;
-			buffer[1] = file_array[fd].f_dentry.inode_num;
-			buffer[2] = file_array[fd].f_pos;
-			bytes_read = file_array[fd].f_ops.read(buffer, nbytes);
-			
-			//refill buf
-			int i;
-			for (i = 0; i < nbytes; i++)
-			{
-				((uint8_t *)buf)[i] = ((uint8_t *)buffer)[i];
-			}
-		}
-		else
-		{
-			((uint32_t *)buf)[0] = 1;
-			((uint32_t *)buf)[1] = file_array[fd].f_dentry.inode_num;
-			((uint32_t *)buf)[2] = file_array[fd].f_pos;
-			bytes_read = file_array[fd].f_ops.read(buf, nbytes);
-		}
-		
-		if (bytes_read != nbytes)
-		{
-			//end of file reached
-			file_array[fd].eof = 1;
-			if (file_array[fd].f_pos != 0)
-			{
-				return bytes_read - file_array[fd].f_pos;
-			}
-		}
-		file_array[fd].f_pos += bytes_read;
-		return bytes_read;
+	if(check_user_buffer(buf, nbytes) == -1){
+		return -1;
 	}
-	//rtc or directory
-	return file_array[fd].f_ops.read(buf, nbytes);
+	return file_array[fd].f_ops -> read(&file_array[fd], buf, nbytes);
+}
+
+/*
+ * pread
+ *	FUNCTION:		Reads from a file at the given offset without moving the
+ *					file's read position
+ *	INTPUT: 		fd     - file descriptor of an open regular or scratch file
+ *					buf    - buffer to fill
+ *					nbytes - number of bytes to read
+ *					offset - byte of the file to start reading at
+ *	OUTPUT: 		None
+ *	RETURN VALUE: 	Number of bytes read, 0 at end of file, -1 on failure
+ *	SIDE EFFECTS:	Fills the buffer that was passed in
+ */
+int32_t pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset){
+	file_io_t io = {buf, nbytes, offset};
+	if(check_user_buffer(buf, nbytes) == -1){
+		return -1;
+	}
+	return file_ioctl(fd, FIOC_PREAD, (uint32_t)&io);
+}
+
+/*
+ * lseek
+ *	FUNCTION:		Moves the read position of a file
+ *	INTPUT: 		fd     - file descriptor of an open regular or scratch file
+ *					offset - byte offset relative to whence
+ *					whence - SEEK_SET (start of file), SEEK_CUR (current
+ *							 position) or SEEK_END (end of file)
+ *	OUTPUT: 		None
+ *	RETURN VALUE: 	New read position, -1 on failure
+ *	SIDE EFFECTS:	Subsequent reads start at the new position
+ */
+int32_t lseek (int32_t fd, int32_t offset, int32_t whence){
+	//bad file descriptor, or the file can't seek
+	if(fd < 2 || fd > 7 || used_desc[fd] != 1 || file_array[fd].f_ops -> seek == NULL){
+		return -1;
+	}
+	return file_array[fd].f_ops -> seek(&file_array[fd], offset, whence);
 }
 
 /*
@@ -358,33 +658,116 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes){
  *	RETURN VALUE: 	return value of driver specific function
  */
 int32_t write (int32_t fd, const void* buf, int32_t nbytes){
-	//error checking for bad file descriptor or non-rtc file (write is only valid for rtc)
-	if(fd < 0 || fd > 7)
-	{
+	//bad file descriptor, or the file can't be written
+	if(fd < 0 || fd > 7 || used_desc[fd] != 1 || file_array[fd].f_ops -> write == NULL){
 		return -1;
 	}
-	//call write
-	return file_array[fd].f_ops.write(buf, nbytes);
+	return file_array[fd].f_ops -> write(&file_array[fd], buf, nbytes);
+}
+
+/*
+ * ioctl
+ *	FUNCTION: 		Executes file's specific ioctl driver function, which
+ *					carries out the calls that aren't reads, writes or seeks.
+ *					Buffers the command writes through arg are checked first.
+ *	INTPUT: 		fd  - file descriptor of an open file (not stdin or stdout)
+ *		   			cmd - FIOC_* command
+ *		   			arg - argument of the command
+ *	OUTPUT: 		None
+ *	RETURN VALUE: 	return value of driver specific function, -1 if the
+ *					file doesn't support the command or a buffer isn't in
+ *					writable program memory. The close-on-exec commands
+ *					work on every file and return 0.
+ */
+int32_t ioctl (int32_t fd, uint32_t cmd, uint32_t arg){
+	file_io_t * io = (file_io_t *)arg;
+	int32_t size;
+	
+	switch(cmd){
+		case FIOC_STAT:
+			size = sizeof(stat_t);
+			break;
+		case FIOC_GETDENTS:
+		case FIOC_PREAD:
+			//the data goes to the buffer the file_io_t names
+			if(check_user_buffer(io, sizeof(file_io_t)) == -1 || check_user_buffer(io -> buf, io -> nbytes) == -1){
+				return -1;
+			}
+			size = 0;
+			break;
+		case FIOC_MAP_PAGE:
+			size = sizeof(file_page_t);
+			break;
+		case FIOC_READAHEAD_STATS:
+			size = sizeof(fs_readahead_stats_t);
+			break;
+		case FIOC_BCACHE_STATS:
+			size = sizeof(bcache_stats_t);
+			break;
+		case FIOC_DCACHE_STATS:
+			size = sizeof(fs_dcache_stats_t);
+			break;
+		case FIOC_LOOKUP_STATS:
+			size = sizeof(fs_lookup_stats_t);
+			break;
+		case FIOC_PROGRAM_CACHE_STATS:
+			size = sizeof(program_cache_stats_t);
+			break;
+		default:
+			//arg isn't written through
+			size = 0;
+			break;
+	}
+	if(size != 0 && check_user_buffer((void *)arg, size) == -1){
+		return -1;
+	}
+	return file_ioctl(fd, cmd, arg);
+}
+
+/*
+ * file_ioctl
+ *	FUNCTION: 		Carries out an ioctl on an open file for the kernel,
+ *					whose buffers are trusted
+ *	INTPUT: 		fd  - file descriptor of an open file (not stdin or stdout)
+ *		   			cmd - FIOC_* command
+ *		   			arg - argument of the command
+ *	OUTPUT: 		None
+ *	RETURN VALUE: 	return value of driver specific function, -1 if the
+ *					file doesn't support the command. The close-on-exec
+ *					commands work on every file and return 0.
+ */
+int32_t file_ioctl (int32_t fd, uint32_t cmd, uint32_t arg){
+	//bad file descriptor
+	if(fd < 2 || fd > 7 || used_desc[fd] != 1){
+		return -1;
+	}
+	
+	//descriptor flags, the same for every file
+	if(cmd == FIOC_SETCLOEXEC || cmd == FIOC_CLRCLOEXEC){
+		file_array[fd].f_cloexec = (cmd == FIOC_SETCLOEXEC);
+		return 0;
+	}
+	
+	//the file has no ioctls
+	if(file_array[fd].f_ops -> ioctl == NULL){
+		return -1;
+	}
+	return file_array[fd].f_ops -> ioctl(&file_array[fd], cmd, arg);
 }
 
 /*
  * open
- *	FUNCTION: 		Creates a new file_t struct for a given file and assigns it a 
- *					new file descriptor.  Updates the file array and calls the file's 
- *					specific open driver function.
- *	INTPUT:			filename - string name of file to open
+ *	FUNCTION: 		Looks a file up in the file system its path is mounted on
+ *					and assigns it a new file descriptor. The file system picks
+ *					the driver operations the descriptor uses, and the driver's
+ *					open function is called.
+ *	INTPUT:			filename - path of the file to open ('/' separated, from the
+ *							   root directory, scratch files are under "tmp/")
  *	OUTPUT:			used_desc and file array updated
  *	RETURN VALUE:	-1 on failure, integer with file descriptor on success
  */
 int32_t open (const uint8_t* filename){
 	int file_desc = 0;
-	dentry_t dentry;
-	int val = read_dentry_by_name(filename, &dentry);
-	
-	//bad filename
-	if(val == -1){
-		return -1;
-	}
 
 	//find empty file descriptor
 	int pos;
@@ -400,31 +783,9 @@ int32_t open (const uint8_t* filename){
 		return -1;
 	}
 
-	file_t * new_file = file_array + file_desc;
-	(*new_file).f_dentry = dentry;
-	(*new_file).f_pos = 0;
-	(*new_file).eof = 0;
-	
-	//RTC
-	if(dentry.file_type == 0){
-		(*new_file).f_ops.open = &rtc_open;
-		(*new_file).f_ops.read = &rtc_read;
-		(*new_file).f_ops.write = &rtc_write;
-		//Call RTC Open
-		rtc_open();
-	}
-	//Directory
-	else if(dentry.file_type == 1){
-		(*new_file).f_ops.open = &dir_open;
-		(*new_file).f_ops.read = &dir_read;
-		(*new_file).f_ops.write = &dir_write;
-		dir_open();
-	}
-	//Regular file
-	else{
-		(*new_file).f_ops.open = &fs_open;
-		(*new_file).f_ops.read = &fs_read;
-		(*new_file).f_ops.write = &fs_write;
+	//bad filename, or the driver refused it
+	if(vfs_open(filename, &file_array[file_desc]) == -1){
+		return -1;
 	}
 
 	used_desc[file_desc] = 1;
@@ -441,16 +802,180 @@ int32_t open (const uint8_t* filename){
  */
 int32_t close (int32_t fd){
 	//Check for bad file descriptor (you can't close 0, 1, or > 7)
-	if(fd <= 1 || fd > 7)
+	if(fd <= 1 || fd > 7 || used_desc[fd] != 1)
 		return -1;
-	//If RTC file type, close the RTC
-	if(file_array[fd].f_dentry.file_type == 0)
-		rtc_close(fd);
-	//Otherwise just open the used file array location at fd
+	//Let the driver release the file
+	if(file_array[fd].f_ops -> close != NULL)
+		file_array[fd].f_ops -> close(&file_array[fd]);
+	//Open the used file array location at fd
 	used_desc[fd] = 0x0;
 	return 0;
 }
 
+/*
+ * create
+ *	FUNCTION: 		Creates an empty file in the file system its path is
+ *					mounted on and opens it
+ *	INTPUT:			filename - path of the new file
+ *	OUTPUT:			used_desc and file array updated
+ *	RETURN VALUE:	-1 on failure, integer with file descriptor on success
+ */
+int32_t create (const uint8_t* filename){
+	if(vfs_create(filename) == -1){
+		return -1;
+	}
+	return open(filename);
+}
+
+/*
+ * truncate
+ *	FUNCTION: 		Sets the length of an open file, freeing the data past a
+ *					new shorter end or zero filling up to a longer one
+ *	INTPUT:			fd     - file descriptor of an open regular or scratch file
+ *					length - new length of the file in bytes
+ *	OUTPUT:			None
+ *	RETURN VALUE:	-1 on failure, 0 on success
+ */
+int32_t truncate (int32_t fd, uint32_t length){
+	return file_ioctl(fd, FIOC_TRUNCATE, length);
+}
+
+/*
+ * getdents
+ *	FUNCTION: 		Reads as many directory entries as fit into buf, continuing
+ *					from where the last read of the directory stopped
+ *	INTPUT:			fd     - file descriptor of an open directory
+ *					buf    - buffer to fill with dirent_t records
+ *					nbytes - size of buf in bytes
+ *	OUTPUT:			None
+ *	RETURN VALUE:	Number of bytes filled, 0 once every entry has been read,
+ *					-1 on failure
+ */
+int32_t getdents (int32_t fd, void* buf, int32_t nbytes){
+	file_io_t io = {buf, nbytes, 0};
+	if(check_user_buffer(buf, nbytes) == -1){
+		return -1;
+	}
+	return file_ioctl(fd, FIOC_GETDENTS, (uint32_t)&io);
+}
+
+/*
+ * stat
+ *	FUNCTION: 		Gets the size, type, inode and block count of a file
+ *					from the file system its path is mounted on
+ *	INTPUT:			filename - path of the file
+ *					buf      - stat_t to fill
+ *	OUTPUT:			None
+ *	RETURN VALUE:	-1 on failure, 0 on success
+ */
+int32_t stat (const uint8_t* filename, stat_t* buf){
+	if(check_user_buffer(buf, sizeof(stat_t)) == -1){
+		return -1;
+	}
+	return vfs_stat(filename, buf);
+}
+
+/*
+ * fstat
+ *	FUNCTION: 		Gets the size, type, inode and block count of an open file
+ *	INTPUT:			fd  - file descriptor of an open file (not stdin or stdout)
+ *					buf - stat_t to fill
+ *	OUTPUT:			None
+ *	RETURN VALUE:	-1 on failure, 0 on success
+ */
+int32_t fstat (int32_t fd, stat_t* buf){
+	if(check_user_buffer(buf, sizeof(stat_t)) == -1){
+		return -1;
+	}
+	return file_ioctl(fd, FIOC_STAT, (uint32_t)buf);
+}
+
+/*
+ * unlink
+ *	FUNCTION: 		Removes a file from the file system its path is mounted
+ *					on. Open file descriptors of a scratch file keep working
+ *					and its memory is freed when the last is closed.
+ *	INTPUT:			filename - path of the file
+ *	OUTPUT:			None
+ *	RETURN VALUE:	-1 on failure (including files of the boot image), 0 on
+ *					success
+ */
+int32_t unlink (const uint8_t* filename){
+	return vfs_unlink(filename);
+}
+
+/*
+ * fork
+ * FUNCTION: 		Makes a copy of the calling process that runs alongside it
+ *					in the same terminal. The copy gets its own pid, a copy
+ *					of the open files (positions are no longer shared) and
+ *					the caller's memory, shared copy-on-write until either
+ *					process writes to a page. It returns from the system
+ *					call the next time the scheduler picks it.
+ * INTPUT: 			None
+ * OUTPUT: 			None
+ * RETURN VALUE: 	The child's pid to the caller and 0 to the child,
+ *					-1 if no more processes can be run
+ * SIDE EFFECTS:	Caller's writable pages become copy-on-write
+ */
+int32_t fork (void){
+	cli();
+	if(current_pcb == NULL || num_process > 6){
+		return -1;
+	}
+	
+	int pid_pos = 0;
+	while(pid_pos < 6 && open_pid[pid_pos] == 1){
+		pid_pos++;
+	}
+	if(pid_pos == 6){
+		return -1;
+	}
+	open_pid[pid_pos] = 1;  //pid is now taken by new process
+	pid_pos++;              //new process's pid is pid_pos + 1
+	
+	pcb_t * parent = current_pcb;
+	pcb_t * pcb = get_pcb(pid_pos);
+	memcpy(pcb, parent, sizeof(pcb_t));
+	pcb -> pid = pid_pos;
+	pcb -> parent_pid = parent -> pid;
+	pcb -> parent_pcb = parent;
+	pcb -> blocked = 0;
+	pcb -> detached = 1;
+	pcb -> exited = 0;
+	pcb -> waiting = 0;
+	pcb -> k_esp = 0;
+	pcb -> k_ebp = 0;
+	
+	//both processes hold the files now
+	int fd;
+	for(fd = 2; fd < 8; fd++){
+		if(pcb -> used_desc[fd] == 1 && pcb -> file_array[fd].f_ops -> dup != NULL){
+			pcb -> file_array[fd].f_ops -> dup(&pcb -> file_array[fd]);
+		}
+	}
+	
+	copy_user_pages(parent -> pid, pcb -> pid);
+	memcpy(mmap_page_tables[pcb -> pid - 1], mmap_page_tables[parent -> pid - 1], sizeof(mmap_page_tables[0]));
+	uint32_t i;
+	for(i = 0; i < pcb -> num_mmaps; i++){
+		fs_map_ref(pcb -> mmap_files[i]);
+	}
+	
+	//the child leaves the kernel through a copy of the caller's system call
+	//frame, the scheduler starts it at fork_child_return
+	uint8_t * frame = (uint8_t *)pcb + 8192 - SYS_CALL_FRAME;
+	memcpy(frame, (uint8_t *)parent + 8192 - SYS_CALL_FRAME, SYS_CALL_FRAME);
+	pcb -> ret_eip = (uint32_t)fork_child_return;
+	pcb -> ret_cs = KERNEL_CS;
+	pcb -> ret_flags = 0x2;
+	pcb -> ret_esp = (uint32_t)frame;
+	pcb -> ret_ebp = (uint32_t)frame;
+	
+	num_process++;
+	return pcb -> pid;
+}
+
 /*
  * getargs
  * 	FUNCTION:	 	Reads the programs command line arguments into a user-level buffer.
@@ -461,7 +986,7 @@ int32_t close (int32_t fd){
  * 	SIDE EFFECTS:	Moves command line arguments in the memory starting at *buf
  */
 int32_t getargs (uint8_t* buf, int32_t nbytes){
-	if (nbytes < ARGS_MAX)
+	if (nbytes < ARGS_MAX || check_user_buffer(buf, nbytes) == -1)
 		return -1;
 		
 	strcpy((int8_t*)buf, current_pcb -> args );
@@ -480,8 +1005,8 @@ int32_t getargs (uint8_t* buf, int32_t nbytes){
  *	SIDE EFFECTS: 	None
  */
 int32_t vidmap (uint8_t** screen_start){
-	//test if pointer to fill is inside user space (128MB - 132MB)
-	if(screen_start < (uint8_t **)0x08000000 || screen_start > (uint8_t **)0x08400000){
+	//test if pointer to fill is in writable user space (128MB - 132MB)
+	if(check_user_buffer(screen_start, sizeof(*screen_start)) == -1){
 		return -1;
 	}
 	*screen_start = (uint8_t *)0x10000000;  //256 MB virtual address for video memory
@@ -489,6 +1014,74 @@ int32_t vidmap (uint8_t** screen_start){
 	return 0;
 }
 
+/*
+ * mmap
+ *	FUNCTION:		Maps the pages of an open file read-only into the caller's
+ *					file mapping area at 132MB, so the file can be read in
+ *					place without copying. The driver finds each 4KB page in
+ *					memory (for regular files, their data blocks), and pages
+ *					that are scattered are still mapped to one contiguous
+ *					virtual range. The file can't shrink while it is
+ *					mapped, and writes to it reach the mapping.
+ *	INTPUT: 		fd    - file descriptor of an open file whose driver can
+ *							map its pages
+ *					start - pointer in user space to fill with the address
+ *							of the first byte of the file
+ *	OUTPUT: 		None
+ *	RETURN VALUE: 	Length of the mapped file in bytes, -1 on failure
+ *	SIDE EFFECTS: 	Caller's mapping page table is updated, TLB is flushed
+ */
+int32_t mmap (int32_t fd, uint8_t** start){
+	stat_t info;
+	file_page_t page;
+	
+	//bad file descriptor
+	if(file_ioctl(fd, FIOC_STAT, (uint32_t)&info) == -1){
+		return -1;
+	}
+	//test if pointer to fill is inside user space (128MB - 132MB)
+	if(check_user_buffer(start, sizeof(uint8_t *)) == -1){
+		return -1;
+	}
+	
+	uint32_t length = info.size;
+	uint32_t num_pages = (length + 4095) / 4096;
+	uint32_t first = current_pcb -> mmap_next;
+	
+	//nothing to map or no room left
+	if(num_pages == 0 || first + num_pages > MMAP_PAGES || current_pcb -> num_mmaps == PCB_MAX_MMAPS){
+		return -1;
+	}
+	
+	//the file can't shrink under the mapping
+	fs_mapped_file_t * mapped = fs_map_file(&file_array[fd]);
+	if(mapped == NULL){
+		return -1;
+	}
+	
+	//map each page as a present, user, read-only page
+	unsigned int * table = mmap_page_tables[(current_pcb -> pid) - 1];
+	uint32_t i;
+	for(i = 0; i < num_pages; i++){
+		page.page = i;
+		if(file_ioctl(fd, FIOC_MAP_PAGE, (uint32_t)&page) == -1){
+			//page not in memory, undo what was mapped
+			while(i > 0){
+				table[first + --i] = 0;
+			}
+			fs_map_release(mapped);
+			return -1;
+		}
+		table[first + i] = page.address | 5;
+	}
+	asm volatile("mov %0, %%cr3":: "b"(page_dir));
+	
+	current_pcb -> mmap_next = first + num_pages;
+	current_pcb -> mmap_files[current_pcb -> num_mmaps++] = mapped;
+	*start = (uint8_t *)(MMAP_START + (first * 4096));
+	return length;
+}
+
 /*
  * set_handler (NOT IMPLEMENTED / EXTRA CREDIT)
  * FUNCTION:
@@ -576,6 +1169,16 @@ void swap_video_pages(int terminal_num, int foreground){
 void update_screen_x_y(pcb_t * pcb){
 	pcb -> screen_x = get_screen_x(); 
 	pcb -> screen_y = get_screen_y();
+	
+	//processes sharing the terminal print from the same position
+	int pid;
+	for(pid = 1; pid <= 6; pid++){
+		pcb_t * other = get_pcb(pid);
+		if(open_pid[pid-1] == 1 && other != pcb && other -> terminal_id == pcb -> terminal_id){
+			other -> screen_x = pcb -> screen_x;
+			other -> screen_y = pcb -> screen_y;
+		}
+	}
 }
 
 /*
@@ -667,6 +1270,244 @@ void update_cur_pcb(pcb_t * new_pcb){
 	update_cur_buf(new_pcb);
 }
 
+/*
+ * map_process_pages
+ * FUNCTION: 		Points the user pages of the page directory at a process:
+ *					its program memory at 128MB and its file mappings at 132MB
+ * INTPUT: 			pid - process id of the process to map
+ * OUTPUT: 			None
+ * RETURN VALUE: 	None
+ * SIDE EFFECTS:	Page directory updated, TLB is flushed
+ */
+void map_process_pages(int pid){
+	mapped_pid = pid;
+	page_dir[32] = (unsigned int)user_page_tables[pid-1] | 7;
+	page_dir[33] = (unsigned int)mmap_page_tables[pid-1] | 7;
+	asm volatile("mov %0, %%cr3":: "b"(page_dir));
+}
+
+/*
+ * map_user_page
+ * FUNCTION: 		Maps a 4KB page of program memory on its first touch.
+ *					Pages holding bytes of the program's executable share
+ *					the frame of the program page cache with every process
+ *					running it, read-only and copied on the first write if a
+ *					segment on them is writable. Other pages get a frame of
+ *					their own, zeroed unless they are .bss of a segment.
+ * INTPUT: 			addr - faulting address
+ * OUTPUT: 			None
+ * RETURN VALUE: 	0 if the page was mapped, -1 if the address isn't in the
+ *					mapped process's program memory, its page is already
+ *					there or there is no free frame
+ * SIDE EFFECTS:	Process's program page table updated
+ */
+int32_t map_user_page(uint32_t addr){
+	if(mapped_pid == 0 || addr < USER_START || addr >= MMAP_START){
+		return -1;
+	}
+	
+	unsigned int * table = user_page_tables[mapped_pid - 1];
+	uint32_t page = (addr - USER_START) >> 12;
+	if(table[page] != 0){
+		return -1;
+	}
+	
+	//frames are identity mapped for the kernel
+	uint32_t frame = 0;
+	int32_t flags = get_program_page(get_pcb(mapped_pid), USER_START + (page * 4096), &frame);
+	if(flags == -1){
+		//stack and memory past the program start zeroed
+		frame = page_alloc();
+		if(frame != 0){
+			memset((void *)frame, 0, 4096);
+		}
+		flags = PROGRAM_PAGE_WRITABLE;
+	}
+	if(frame == 0){
+		return -1;
+	}
+	
+	if(flags & PROGRAM_PAGE_SHARED){
+		table[page] = frame | 5 | ((flags & PROGRAM_PAGE_WRITABLE) ? PTE_COW : 0);
+	}
+	else{
+		table[page] = frame | ((flags & PROGRAM_PAGE_WRITABLE) ? 7 : 5);
+	}
+	return 0;
+}
+
+/*
+ * copy_user_page
+ * FUNCTION: 		Gives a process its own copy of a copy-on-write page of
+ *					program memory it writes to. The last process holding
+ *					the frame just makes it writable.
+ * INTPUT: 			addr - faulting address
+ * OUTPUT: 			None
+ * RETURN VALUE: 	0 if the page is now writable, -1 if the address isn't
+ *					on a copy-on-write page of the mapped process or there
+ *					is no free frame
+ * SIDE EFFECTS:	Process's program page table updated, TLB is flushed
+ */
+int32_t copy_user_page(uint32_t addr){
+	if(mapped_pid == 0 || addr < USER_START || addr >= MMAP_START){
+		return -1;
+	}
+	
+	unsigned int * table = user_page_tables[mapped_pid - 1];
+	uint32_t page = (addr - USER_START) >> 12;
+	if(!(table[page] & 1) || !(table[page] & PTE_COW)){
+		return -1;
+	}
+	
+	uint32_t frame = table[page] & ~0xFFF;
+	if(page_ref_count(frame) > 1){
+		uint32_t copy = page_alloc();
+		if(copy == 0){
+			return -1;
+		}
+		memcpy((void *)copy, (void *)frame, 4096);
+		page_unref(frame);
+		frame = copy;
+	}
+	table[page] = frame | 7;
+	asm volatile("mov %0, %%cr3":: "b"(page_dir));
+	return 0;
+}
+
+/*
+ * copy_user_pages
+ * FUNCTION: 		Gives a process the program memory of another. Both
+ *					share every frame, the writable ones become copy-on-write
+ *					in both processes.
+ * INTPUT: 			from - process id of the process to copy
+ *					to   - process id of the process getting the copy, its
+ *						   program memory must be empty
+ * OUTPUT: 			None
+ * RETURN VALUE: 	None
+ * SIDE EFFECTS:	Both processes' program page tables updated, TLB is flushed
+ */
+void copy_user_pages(int from, int to){
+	unsigned int * src = user_page_tables[from-1];
+	unsigned int * dst = user_page_tables[to-1];
+	int i;
+	
+	for(i = 0; i < 1024; i++){
+		if(src[i] & 1){
+			page_ref(src[i] & ~0xFFF);
+			if(src[i] & (2 | PTE_COW)){
+				src[i] = (src[i] & ~2) | PTE_COW;
+			}
+		}
+		dst[i] = src[i];
+	}
+	asm volatile("mov %0, %%cr3":: "b"(page_dir));
+}
+
+/*
+ * clear_user_pages
+ * FUNCTION: 		Unmaps every page of a process's program memory
+ * INTPUT: 			pid - process id of the process
+ * OUTPUT: 			None
+ * RETURN VALUE: 	None
+ * SIDE EFFECTS:	Process's program page table updated, its references to
+ *					the frames are dropped
+ */
+void clear_user_pages(int pid){
+	unsigned int * table = user_page_tables[pid-1];
+	int i;
+	
+	for(i = 0; i < 1024; i++){
+		if(table[i] & 1){
+			page_unref(table[i] & ~0xFFF);
+		}
+	}
+	memset(table, 0, sizeof(user_page_tables[pid-1]));
+}
+
+/*
+ * clear_mmap
+ * FUNCTION: 		Removes every file mapping of a process
+ * INTPUT: 			pid - process id of the process
+ * OUTPUT: 			None
+ * RETURN VALUE: 	None
+ * SIDE EFFECTS:	Process's mapping page table and pcb updated
+ */
+void clear_mmap(int pid){
+	pcb_t * pcb = get_pcb(pid);
+	uint32_t i;
+	
+	for(i = 0; i < pcb -> num_mmaps; i++){
+		fs_map_release(pcb -> mmap_files[i]);
+	}
+	pcb -> num_mmaps = 0;
+	memset(mmap_page_tables[pid-1], 0, sizeof(mmap_page_tables[pid-1]));
+	pcb -> mmap_next = 0;
+}
+
+/*
+ * program_running
+ * FUNCTION: 		Checks if a live process is running an executable. Its
+ *					pages are read from the file as they are touched, so the
+ *					file can't change under it.
+ * INTPUT: 			inode - inode of the executable on the boot volume
+ * OUTPUT: 			None
+ * RETURN VALUE: 	1 if a process that hasn't halted runs it, 0 otherwise
+ * SIDE EFFECTS:	None
+ */
+int32_t program_running(uint32_t inode){
+	int pid;
+	
+	for(pid = 1; pid <= 6; pid++){
+		pcb_t * pcb = get_pcb(pid);
+		if(open_pid[pid-1] == 1 && !pcb -> exited && pcb -> exe_inode == inode){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * check_user_buffer
+ * FUNCTION: 		Checks a buffer a system call writes its result to. It
+ *					has to lie in the caller's program memory: the kernel
+ *					below 128MB is off limits, and the file mapping area
+ *					is read-only and points straight at image blocks.
+ *					With CR0.WP set, a kernel write to a read-only program
+ *					page would fault, so those pages are refused as well.
+ * INTPUT: 			buf    - start of the buffer
+ *					nbytes - bytes the call may write
+ * OUTPUT: 			None
+ * RETURN VALUE: 	0 if the buffer can be written (or nbytes is 0 or less),
+ *					-1 if it isn't all inside program memory or covers a
+ *					page that is read-only or can't be mapped
+ * SIDE EFFECTS:	Pages of the buffer are mapped
+ */
+int32_t check_user_buffer(const void* buf, int32_t nbytes){
+	uint32_t start = (uint32_t)buf;
+	uint32_t end = start + nbytes;
+	
+	if(nbytes <= 0){
+		return 0;
+	}
+	if(end < start || start < USER_START || end > MMAP_START){
+		return -1;
+	}
+	
+	//pages of program memory have to take the write, copy-on-write ones
+	//are copied by the page fault handler
+	uint32_t addr;
+	for(addr = start & ~0xFFF; addr < end; addr += 4096){
+		unsigned int * entry = &user_page_tables[mapped_pid - 1][(addr - USER_START) >> 12];
+		if(!(*entry & 1) && map_user_page(addr) == -1){
+			return -1;
+		}
+		if(!(*entry & (2 | PTE_COW))){
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /*
  * sys_call_pd_addrs
  *	FUNCTION: 		Updates local page directory pointer
@@ -740,6 +1581,48 @@ void clear_pcb(int pid){
 	get_pcb(pid) -> pid = 0;
 }
 
+/*
+ * free_process
+ *	FUNCTION: 		Frees the pid of a halted spawned or forked process
+ *	INTPUT: 		int pid - Process ID
+ *	OUTPUT:			None
+ *	RETURN VALUE:	None
+ *	SIDE EFFECTS:	pid can be given to another process
+ */
+void free_process(int pid){
+	open_pid[pid-1] = 0;
+	clear_pcb(pid);
+	num_process--;
+}
+
+/*
+ * orphan_children
+ *	FUNCTION: 		Leaves the spawned and forked children of a halting
+ *					process without a parent, so they free their pid when
+ *					they halt. The ones already halted are freed.
+ *	INTPUT: 		int pid - Process ID of the halting process
+ *	OUTPUT:			None
+ *	RETURN VALUE:	None
+ *	SIDE EFFECTS:	Children's pcbs updated
+ */
+void orphan_children(int pid){
+	int i;
+	
+	for(i = 1; i <= 6; i++){
+		pcb_t * child = get_pcb(i);
+		if(open_pid[i-1] != 1 || !child -> detached || child -> parent_pid != pid){
+			continue;
+		}
+		if(child -> exited){
+			free_process(i);
+		}
+		else{
+			child -> parent_pid = 0;
+			child -> parent_pcb = 0x0;
+		}
+	}
+}
+
 /*
  * clear_video_mem
  *	FUNCTION: 		Clears video memory related to given PID
@@ -774,8 +1657,7 @@ void jump_to_process(int pid){
 	change_to_virtual_rtc(pid);
 	
 	//update 128MB page to process's page
-	page_dir[32] = (0x800000 + (0x400000 * (pid-1))) | 0x87;
-	asm volatile("mov %0, %%cr3":: "b"(page_dir));
+	map_process_pages(pid);
 	
 	pcb_t * pcb = get_pcb(pid);
 	
@@ -944,6 +1826,30 @@ void increment_cur_process(){
 	}
 }
 
+/*
+ * next_runnable
+ *	FUNCTION:		Finds the process of a terminal to run after another,
+ *					going round the pids. Processes waiting in execute for
+ *					a child are skipped.
+ *	INPUT:			term  - terminal of the process
+ *					after - pid to start after, it is the last one checked
+ *	OUTPUT:			None
+ *	RETURN VALUE:	The pid, 0 if no process of the terminal can run
+ *	SIDE EFFECTS:	None
+ */
+int next_runnable(int term, int after){
+	int i, pid;
+	
+	for(i = 1; i <= 6; i++){
+		pid = (after + i - 1) % 6 + 1;
+		pcb_t * pcb = get_pcb(pid);
+		if(open_pid[pid-1] == 1 && pcb -> terminal_id == term && !pcb -> blocked && !pcb -> exited){
+			return pid;
+		}
+	}
+	return 0;
+}
+
 /*
  * get_next_process
  *	FUNCTION:		Determines which process comes next
@@ -967,6 +1873,12 @@ int get_next_process(){
 	cur_terminal = cur_process;
 	update_cur_terminal(cur_terminal);
 	
+	//take turns between the processes of the terminal
+	int next = next_runnable(cur_terminal, active_process[cur_terminal]);
+	if(next != 0){
+		active_process[cur_terminal] = next;
+	}
+	
 	if(current_pcb != NULL){
 		copy_video_mem_out(current_pcb -> terminal_id);
 		update_screen_x_y(current_pcb);
@@ -15,6 +15,9 @@
 
 #define ARGS_MAX 32
 
+//waitpid flag, return 0 instead of waiting if the child is still running
+#define WNOHANG 1
+
 volatile int terminal_waiting; 
 
 int32_t halt(uint8_t status);
@@ -27,6 +30,23 @@ int32_t getargs(uint8_t* buf, int32_t nbytes);
 int32_t vidmap(uint8_t** screen_start);
 int32_t set_handler(int32_t signum, void* handler_address);
 int32_t sigreturn(void);
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence);
+int32_t mmap(int32_t fd, uint8_t** start);
+int32_t create(const uint8_t* filename);
+int32_t truncate(int32_t fd, uint32_t length);
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes);
+int32_t stat(const uint8_t* filename, stat_t* buf);
+int32_t fstat(int32_t fd, stat_t* buf);
+int32_t unlink(const uint8_t* filename);
+int32_t ioctl(int32_t fd, uint32_t cmd, uint32_t arg);
+int32_t file_ioctl(int32_t fd, uint32_t cmd, uint32_t arg);
+int32_t fork(void);
+int32_t spawn(const uint8_t* command);
+int32_t exec(const uint8_t* command);
+int32_t waitpid(int32_t pid, int32_t* status, int32_t flags);
+void split_command(int8_t* com, int8_t* args);
+pcb_t * load_command(const uint8_t* command, int8_t* args, uint32_t* esp, uint32_t* eip);
 void switch_terminal(int num);
 void update_addrs();
 void update_screen_x_y(pcb_t * pcb);
@@ -36,12 +56,23 @@ void copy_video_mem_in(int terminal_id);
 void swap_video_pages(int terminal_num, int foreground);
 void update_video_page_pointer(unsigned int * new_video_page);
 void sys_call_pd_addrs(unsigned int * page_directory);
+void map_process_pages(int pid);
+void clear_mmap(int pid);
+int32_t check_user_buffer(const void* buf, int32_t nbytes);
+int32_t program_running(uint32_t inode);
+int32_t map_user_page(uint32_t addr);
+int32_t copy_user_page(uint32_t addr);
+void copy_user_pages(int from, int to);
+void clear_user_pages(int pid);
 pcb_t * get_pcb(int pid);
 void update_cur_pcb(pcb_t * new_pcb);
 void clear_pcb(int pid);
+void free_process(int pid);
+void orphan_children(int pid);
 void clear_video_mem(int pid);
 void jump_to_process(int pid);
 void store_state();
+int next_runnable(int term, int after);
 int get_next_process();
 void clear_foregrounds();
 void print_buffer();
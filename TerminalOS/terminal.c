@@ -103,13 +103,14 @@ int32_t terminal_open(){
 /*
  * terminal_read
  *   DESCRIPTION:	Reads nbytes from the terminal and enters them into buf.  Reads up to nbytes or new line or null character.
- *   INPUTS: 		buf - buffer to fill
+ *   INPUTS: 		file - open file; not used in the function
+ *					buf - buffer to fill
  *					nbytes - number of bytes to read
  *   OUTPUTS: 		none
  *   RETURN VALUE:	number of bytes actually read, -1 on error
  *   SIDE EFFECTS:	Modifies buf
  */
-int32_t terminal_read(void* buf, int32_t nbytes){
+int32_t terminal_read(file_t * file, void* buf, int32_t nbytes){
 	
 	sti();
 	
@@ -176,13 +177,14 @@ int32_t terminal_read(void* buf, int32_t nbytes){
 /*
  * terminal_write
  *   DESCRIPTION:	Writes nbytes from buf to the terminal.
- *   INPUTS: 		buf - buffer to read from
+ *   INPUTS: 		file - open file (NULL for keyboard echo); not used in the function
+ *					buf - buffer to read from
  *					nbytes - number of bytes to write
  *   OUTPUTS:		none
  *   RETURN VALUE:	number of bytes actually written
  *   SIDE EFFECTS:	Bytes written to screen
  */
-int32_t terminal_write(const void* buf, int32_t nbytes){
+int32_t terminal_write(file_t * file, const void* buf, int32_t nbytes){
 	cli();
 	terminal_clear();
 	int i;
@@ -266,6 +268,26 @@ int32_t terminal_close(){
 	return -1;
 }
 
+//Operations of stdin
+const file_operations_t terminal_stdin_fops = {
+	.open = NULL,
+	.read = &terminal_read,
+	.write = NULL,
+	.close = NULL,
+	.seek = NULL,
+	.ioctl = NULL
+};
+
+//Operations of stdout
+const file_operations_t terminal_stdout_fops = {
+	.open = NULL,
+	.read = NULL,
+	.write = &terminal_write,
+	.close = NULL,
+	.seek = NULL,
+	.ioctl = NULL
+};
+
 /*
  * terminal_backspace
  *   DESCRIPTION: Deletes character immediately before cursor
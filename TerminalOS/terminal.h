@@ -9,10 +9,15 @@
 void terminal_init();
 
 int32_t terminal_open();
-int32_t terminal_read(void* buf, int32_t nbytes);
-int32_t terminal_write(const void* buf, int32_t nbytes);
+int32_t terminal_read(file_t * file, void* buf, int32_t nbytes);
+int32_t terminal_write(file_t * file, const void* buf, int32_t nbytes);
 int32_t terminal_close();
 
+//Operations of stdin and stdout, the terminal is never opened or closed
+//through them
+extern const file_operations_t terminal_stdin_fops;
+extern const file_operations_t terminal_stdout_fops;
+
 void terminal_backspace();
 void terminal_enter();
 void terminal_enter_off();
@@ -0,0 +1,498 @@
+/* tmpfs.c
+ * In-memory file system for scratch files, mounted at "tmp". File data lives in
+ * pages from the page allocator, found through a per-file index page, so
+ * reads and writes copy straight between the user buffer and the data
+ * pages. Pages are only allocated when written, and the files are lost on
+ * reboot.
+ */
+
+#include "tmpfs.h"
+
+/***************************TMPFS GLOBAL VARIABLES***********************************/
+
+//Scratch files, indexed by inode number
+tmpfs_inode_t tmpfs_inodes[TMPFS_MAX_FILES];
+
+/***************************PRIVATE TMPFS FUNCTIONS**********************************/
+
+/*
+ * tmpfs_find
+ *   DESCRIPTION:	Looks a name up among the files that haven't been unlinked
+ *   INPUTS:		name - file name checked by tmpfs_check_name
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Inode number, -1 if there is no such file
+ *   SIDE EFFECTS:	None
+ */
+static int32_t tmpfs_find(const uint8_t * name){
+	uint32_t len = strlen((int8_t *)name);
+	int32_t i;
+
+	for (i = 0; i < TMPFS_MAX_FILES; i++)
+	{
+		tmpfs_inode_t * node = &tmpfs_inodes[i];
+		if (!node -> used || node -> unlinked)
+			continue;
+		if (strncmp((int8_t *)name, (int8_t *)node -> name, len) == 0 && (len == 32 || node -> name[len] == '\0'))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * tmpfs_free_pages
+ *   DESCRIPTION:	Frees the data pages of a file from a page index on
+ *   INPUTS:		node  - scratch file
+ *					first - first page index to free
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	The pages go back to the page allocator
+ */
+static void tmpfs_free_pages(tmpfs_inode_t * node, uint32_t first){
+	uint32_t i;
+
+	if (node -> pages == NULL)
+		return;
+	for (i = first; i < TMPFS_MAX_PAGES && node -> num_pages > 0; i++)
+	{
+		if (node -> pages[i] != 0)
+		{
+			page_free(node -> pages[i]);
+			node -> pages[i] = 0;
+			node -> num_pages--;
+		}
+	}
+}
+
+/*
+ * tmpfs_check_name
+ *   DESCRIPTION:	Checks a name given to the file system
+ *   INPUTS:		name - path inside the file system
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 if it is a file name, -1 if it is empty, too long or
+ *					has a '/' (tmpfs has no subdirectories)
+ *   SIDE EFFECTS:	None
+ */
+static int32_t tmpfs_check_name(const uint8_t * name){
+	uint32_t len;
+
+	for (len = 0; name[len] != '\0'; len++)
+	{
+		if (name[len] == '/' || len == 32)
+			return -1;
+	}
+	return (len == 0) ? -1 : 0;
+}
+
+/*
+ * tmpfs_copy_out
+ *   DESCRIPTION:	Copies file data into buf a page at a time, with holes
+ *					read as zeros
+ *   INPUTS:		node   - scratch file
+ *					offset - first byte to copy
+ *					buf    - buffer to fill
+ *					nbytes - number of bytes to copy
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes copied, 0 at or past end of file
+ *   SIDE EFFECTS:	None
+ */
+static int32_t tmpfs_copy_out(tmpfs_inode_t * node, uint32_t offset, uint8_t * buf, uint32_t nbytes){
+	uint32_t done = 0;
+
+	if (offset >= node -> length)
+		return 0;
+	if (nbytes > node -> length - offset)
+		nbytes = node -> length - offset;
+
+	while (done < nbytes)
+	{
+		uint32_t page = offset / PAGE_SIZE;
+		uint32_t page_off = offset % PAGE_SIZE;
+		uint32_t len = PAGE_SIZE - page_off;
+		if (len > nbytes - done)
+			len = nbytes - done;
+
+		if (node -> pages != NULL && node -> pages[page] != 0)
+			memcpy(buf + done, (uint8_t *)node -> pages[page] + page_off, len);
+		else
+			memset(buf + done, 0, len);
+
+		done += len;
+		offset += len;
+	}
+	return done;
+}
+
+/*
+ * tmpfs_release
+ *   DESCRIPTION:	Frees a file's pages and its slot
+ *   INPUTS:		node - scratch file
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	The slot can hold a new file
+ */
+static void tmpfs_release(tmpfs_inode_t * node){
+	tmpfs_free_pages(node, 0);
+	if (node -> pages != NULL)
+		page_free((uint32_t)node -> pages);
+	memset(node, 0, sizeof(tmpfs_inode_t));
+}
+
+/************************************************************************************/
+
+/*
+ * tmpfs_init
+ *   DESCRIPTION:	Empties the file system
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	Every slot is free
+ */
+void tmpfs_init(){
+	memset(tmpfs_inodes, 0, sizeof(tmpfs_inodes));
+}
+
+/*
+ * tmpfs_lookup
+ *   DESCRIPTION:	Fills a dentry for a scratch file
+ *   INPUTS:		mnt    - mount of the file system
+ *					path   - file name
+ *					dentry - dentry to fill
+ *					fops   - filled with the scratch file operations
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if there is no such file
+ *   SIDE EFFECTS:	None
+ */
+int32_t tmpfs_lookup(vfs_mount_t * mnt, const uint8_t * path, dentry_t * dentry, const file_operations_t ** fops){
+	int32_t inode;
+
+	if (tmpfs_check_name(path) == -1 || (inode = tmpfs_find(path)) == -1)
+		return -1;
+
+	memcpy(dentry -> file_name, tmpfs_inodes[inode].name, 32);
+	dentry -> file_type = 3;
+	dentry -> inode_num = inode;
+	*fops = &tmpfs_fops;
+	return 0;
+}
+
+/*
+ * tmpfs_create
+ *   DESCRIPTION:	Creates an empty scratch file, it takes no pages until
+ *					written
+ *   INPUTS:		mnt  - mount of the file system
+ *					path - file name
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the name is bad or taken or every
+ *					slot is in use
+ *   SIDE EFFECTS:	A slot is taken
+ */
+int32_t tmpfs_create(vfs_mount_t * mnt, const uint8_t * path){
+	int32_t i;
+
+	if (tmpfs_check_name(path) == -1 || tmpfs_find(path) != -1)
+		return -1;
+
+	for (i = 0; i < TMPFS_MAX_FILES; i++)
+	{
+		if (!tmpfs_inodes[i].used)
+		{
+			memset(&tmpfs_inodes[i], 0, sizeof(tmpfs_inode_t));
+			memcpy(tmpfs_inodes[i].name, path, strlen((int8_t *)path));
+			tmpfs_inodes[i].used = 1;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/*
+ * tmpfs_unlink
+ *   DESCRIPTION:	Removes a scratch file's name. Its pages are freed now, or
+ *					by the last close if the file is open.
+ *   INPUTS:		mnt  - mount of the file system
+ *					path - file name
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if there is no such file
+ *   SIDE EFFECTS:	The name can be created again
+ */
+int32_t tmpfs_unlink(vfs_mount_t * mnt, const uint8_t * path){
+	int32_t inode;
+
+	if (tmpfs_check_name(path) == -1 || (inode = tmpfs_find(path)) == -1)
+		return -1;
+
+	if (tmpfs_inodes[inode].open_count > 0)
+		tmpfs_inodes[inode].unlinked = 1;
+	else
+		tmpfs_release(&tmpfs_inodes[inode]);
+	return 0;
+}
+
+/*
+ * tmpfs_stat
+ *   DESCRIPTION:	Fills a stat_t for a scratch file
+ *   INPUTS:		mnt    - mount of the file system
+ *					dentry - dentry from tmpfs_lookup
+ *					buf    - stat_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	None
+ */
+int32_t tmpfs_stat(vfs_mount_t * mnt, const dentry_t * dentry, stat_t * buf){
+	if (dentry == NULL || buf == NULL || dentry -> inode_num >= TMPFS_MAX_FILES)
+		return -1;
+
+	buf -> type = dentry -> file_type;
+	buf -> inode = dentry -> inode_num;
+	buf -> size = tmpfs_inodes[dentry -> inode_num].length;
+	buf -> blocks = tmpfs_inodes[dentry -> inode_num].num_pages;
+	return 0;
+}
+
+/*
+ * tmpfs_open
+ *   DESCRIPTION:	Opens a scratch file at its start, keeping its slot as
+ *					the open file's private data
+ *   INPUTS:		file - file_t filled with the dentry from tmpfs_lookup
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the dentry is bad
+ *   SIDE EFFECTS:	The file stays until closed, even if unlinked
+ */
+int32_t tmpfs_open(file_t * file){
+	uint32_t inode = file -> f_dentry.inode_num;
+
+	if (inode >= TMPFS_MAX_FILES || !tmpfs_inodes[inode].used)
+		return -1;
+
+	file -> f_private = &tmpfs_inodes[inode];
+	file -> f_pos = 0;
+	tmpfs_inodes[inode].open_count++;
+	return 0;
+}
+
+/*
+ * tmpfs_read
+ *   DESCRIPTION:	Copies file data from the file's position into buf
+ *   INPUTS:		file   - open scratch file
+ *					buf    - buffer to fill
+ *					nbytes - number of bytes to read
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes read, 0 at end of file, -1 on failure
+ *   SIDE EFFECTS:	Moves the file's position past the bytes read
+ */
+int32_t tmpfs_read(file_t * file, void* buf, int32_t nbytes){
+	if (buf == NULL || nbytes < 0)
+		return -1;
+
+	int32_t done = tmpfs_copy_out(file -> f_private, file -> f_pos, buf, nbytes);
+	file -> f_pos += done;
+	return done;
+}
+
+/*
+ * tmpfs_write
+ *   DESCRIPTION:	Copies buf into the file at its position, allocating the
+ *					pages written to. A new page is zeroed only if the write
+ *					doesn't cover all of it.
+ *   INPUTS:		file   - open scratch file
+ *					buf    - data to write
+ *					nbytes - number of bytes to write
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Number of bytes written, -1 if nothing could be written
+ *   SIDE EFFECTS:	Moves the file's position past the bytes written, the
+ *					file grows if they go past its end
+ */
+int32_t tmpfs_write(file_t * file, const void* buf, int32_t nbytes){
+	tmpfs_inode_t * node = file -> f_private;
+	const uint8_t * src = (const uint8_t *)buf;
+	uint32_t done = 0;
+
+	if (buf == NULL || nbytes < 0 || file -> f_pos >= TMPFS_MAX_SIZE)
+		return -1;
+	if (nbytes > TMPFS_MAX_SIZE - file -> f_pos)
+		nbytes = TMPFS_MAX_SIZE - file -> f_pos;
+
+	//first write, the index starts out as all holes
+	if (node -> pages == NULL && nbytes > 0)
+	{
+		node -> pages = (uint32_t *)page_alloc();
+		if (node -> pages == NULL)
+			return -1;
+		memset(node -> pages, 0, PAGE_SIZE);
+	}
+
+	while (done < nbytes)
+	{
+		uint32_t page = file -> f_pos / PAGE_SIZE;
+		uint32_t offset = file -> f_pos % PAGE_SIZE;
+		uint32_t len = PAGE_SIZE - offset;
+		if (len > nbytes - done)
+			len = nbytes - done;
+
+		if (node -> pages[page] == 0)
+		{
+			uint32_t frame = page_alloc();
+			if (frame == 0)
+				break;
+			if (len != PAGE_SIZE)
+				memset((void *)frame, 0, PAGE_SIZE);
+			node -> pages[page] = frame;
+			node -> num_pages++;
+		}
+		memcpy((uint8_t *)node -> pages[page] + offset, src + done, len);
+
+		done += len;
+		file -> f_pos += len;
+	}
+
+	if (file -> f_pos > node -> length)
+		node -> length = file -> f_pos;
+	if (done == 0 && nbytes > 0)
+		return -1;
+	return done;
+}
+
+/*
+ * tmpfs_close
+ *   DESCRIPTION:	Closes a scratch file, freeing it if it was unlinked and
+ *					this was its last open file descriptor
+ *   INPUTS:		file - open scratch file
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0
+ *   SIDE EFFECTS:	None
+ */
+int32_t tmpfs_close(file_t * file){
+	tmpfs_inode_t * node = file -> f_private;
+
+	if (node -> open_count > 0)
+		node -> open_count--;
+	if (node -> open_count == 0 && node -> unlinked)
+		tmpfs_release(node);
+	return 0;
+}
+
+/*
+ * tmpfs_dup
+ *   DESCRIPTION:	Counts the copy of an open scratch file a forked process
+ *					gets as another open file descriptor
+ *   INPUTS:		file - copy of the open scratch file
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0
+ *   SIDE EFFECTS:	None
+ */
+int32_t tmpfs_dup(file_t * file){
+	tmpfs_inode_t * node = file -> f_private;
+
+	node -> open_count++;
+	return 0;
+}
+
+/*
+ * tmpfs_seek
+ *   DESCRIPTION:	Moves the position of an open scratch file, which may go
+ *					past its end to leave a hole for the next write
+ *   INPUTS:		file   - open scratch file
+ *					offset - byte offset relative to whence
+ *					whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	New position, -1 on failure
+ *   SIDE EFFECTS:	None
+ */
+int32_t tmpfs_seek(file_t * file, int32_t offset, int32_t whence){
+	tmpfs_inode_t * node = file -> f_private;
+	int32_t base;
+
+	switch (whence)
+	{
+		case SEEK_SET:
+			base = 0;
+			break;
+		case SEEK_CUR:
+			base = file -> f_pos;
+			break;
+		case SEEK_END:
+			base = node -> length;
+			break;
+		default:
+			return -1;
+	}
+
+	if (base + offset < 0)
+		return -1;
+	file -> f_pos = base + offset;
+	return file -> f_pos;
+}
+
+/*
+ * tmpfs_truncate
+ *   DESCRIPTION:	Sets the length of a scratch file. Pages past a shorter
+ *					end are freed and the rest of its last page is zeroed, a
+ *					longer file reads zeros up to its new end.
+ *   INPUTS:		node   - scratch file
+ *					length - new length in bytes
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if length is past the largest file
+ *   SIDE EFFECTS:	None
+ */
+static int32_t tmpfs_truncate(tmpfs_inode_t * node, uint32_t length){
+	if (length > TMPFS_MAX_SIZE)
+		return -1;
+
+	if (length < node -> length && node -> pages != NULL)
+	{
+		uint32_t last = length / PAGE_SIZE;
+		if (length % PAGE_SIZE != 0 && node -> pages[last] != 0)
+			memset((uint8_t *)node -> pages[last] + (length % PAGE_SIZE), 0, PAGE_SIZE - (length % PAGE_SIZE));
+		tmpfs_free_pages(node, (length + PAGE_SIZE - 1) / PAGE_SIZE);
+	}
+	node -> length = length;
+	return 0;
+}
+
+/*
+ * tmpfs_ioctl
+ *   DESCRIPTION:	Carries out fstat, truncate and pread on an open scratch
+ *					file
+ *   INPUTS:		file - open scratch file
+ *					cmd  - FIOC_STAT, FIOC_TRUNCATE or FIOC_PREAD
+ *					arg  - argument of the command
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	Result of the command, -1 on failure or for other commands
+ *   SIDE EFFECTS:	Depends on the command
+ */
+int32_t tmpfs_ioctl(file_t * file, uint32_t cmd, uint32_t arg){
+	file_io_t * io = (file_io_t *)arg;
+
+	switch (cmd)
+	{
+		case FIOC_STAT:
+			return tmpfs_stat(NULL, &file -> f_dentry, (stat_t *)arg);
+		case FIOC_TRUNCATE:
+			return tmpfs_truncate(file -> f_private, arg);
+		case FIOC_PREAD:
+			if (io -> buf == NULL || io -> nbytes < 0)
+				return -1;
+			return tmpfs_copy_out(file -> f_private, io -> offset, io -> buf, io -> nbytes);
+		default:
+			return -1;
+	}
+}
+
+//Operations of an open scratch file
+const file_operations_t tmpfs_fops = {
+	.open = &tmpfs_open,
+	.read = &tmpfs_read,
+	.write = &tmpfs_write,
+	.close = &tmpfs_close,
+	.seek = &tmpfs_seek,
+	.ioctl = &tmpfs_ioctl,
+	.dup = &tmpfs_dup
+};
+
+//Scratch file system
+const vfs_fs_ops_t tmpfs_vfs_ops = {
+	.lookup = &tmpfs_lookup,
+	.create = &tmpfs_create,
+	.unlink = &tmpfs_unlink,
+	.stat = &tmpfs_stat
+};
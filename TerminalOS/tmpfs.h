@@ -0,0 +1,48 @@
+/* tmpfs.h
+ * Header for the in-memory scratch file system
+ */
+
+#ifndef _TMPFS_H
+#define _TMPFS_H
+
+#include "types.h"
+#include "lib.h"
+#include "filesystem.h"
+#include "vfs.h"
+#include "page_alloc.h"
+
+//Files the file system holds, and pages in a file (one index page of
+//page addresses, so 4MB)
+#define TMPFS_MAX_FILES 64
+#define TMPFS_MAX_PAGES (PAGE_SIZE / 4)
+#define TMPFS_MAX_SIZE (TMPFS_MAX_PAGES * PAGE_SIZE)
+
+//Scratch file, its dentries use the slot index as inode number
+typedef struct tmpfs_inode{
+	uint32_t used;			//1 if the slot holds a file
+	uint32_t unlinked;		//1 if the name is gone and the last close frees it
+	uint32_t open_count;	//open file descriptors of the file
+	uint32_t length;		//file size in bytes
+	uint32_t num_pages;		//data pages allocated
+	uint32_t * pages;		//index page of data page addresses, 0 for a hole
+	char name[32];			//not null terminated if 32 characters long
+}tmpfs_inode_t;
+
+void tmpfs_init();
+int32_t tmpfs_lookup(vfs_mount_t * mnt, const uint8_t * path, dentry_t * dentry, const file_operations_t ** fops);
+int32_t tmpfs_create(vfs_mount_t * mnt, const uint8_t * path);
+int32_t tmpfs_unlink(vfs_mount_t * mnt, const uint8_t * path);
+int32_t tmpfs_stat(vfs_mount_t * mnt, const dentry_t * dentry, stat_t * buf);
+int32_t tmpfs_open(file_t * file);
+int32_t tmpfs_read(file_t * file, void* buf, int32_t nbytes);
+int32_t tmpfs_write(file_t * file, const void* buf, int32_t nbytes);
+int32_t tmpfs_close(file_t * file);
+int32_t tmpfs_dup(file_t * file);
+int32_t tmpfs_seek(file_t * file, int32_t offset, int32_t whence);
+int32_t tmpfs_ioctl(file_t * file, uint32_t cmd, uint32_t arg);
+
+//Operations of an open scratch file and of the file system
+extern const file_operations_t tmpfs_fops;
+extern const vfs_fs_ops_t tmpfs_vfs_ops;
+
+#endif /* _TMPFS_H */
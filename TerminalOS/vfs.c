@@ -0,0 +1,197 @@
+/* vfs.c
+ * Virtual file system layer. Paths are routed to the file system mounted
+ * at their first component, which looks the file up and picks the file
+ * operations its open file descriptor uses. System calls on open files
+ * then go straight to those operations.
+ */
+
+#include "vfs.h"
+
+/***************************VFS GLOBAL VARIABLES*************************************/
+
+//Mounted file systems
+vfs_mount_t vfs_mounts[VFS_MAX_MOUNTS];
+
+/************************************************************************************/
+
+/*
+ * vfs_init
+ *   DESCRIPTION:	Empties the mount table
+ *   INPUTS:		None
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	None
+ *   SIDE EFFECTS:	None
+ */
+void vfs_init(){
+	memset(vfs_mounts, 0, sizeof(vfs_mounts));
+}
+
+/*
+ * vfs_mount
+ *   DESCRIPTION:	Mounts a file system
+ *   INPUTS:		name    - first path component routed to it, "" for the
+ *							  file system holding every other path
+ *					ops     - file system operations
+ *					private - file system state handed back to ops
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if the name is bad or taken or the
+ *					table is full
+ *   SIDE EFFECTS:	None
+ */
+int32_t vfs_mount(const int8_t * name, const vfs_fs_ops_t * ops, void * private){
+	uint32_t len = strlen(name);
+	int32_t i, free = -1;
+
+	if (ops == NULL || ops -> lookup == NULL || len >= VFS_NAME_LEN)
+		return -1;
+
+	for (i = 0; i < len; i++)
+	{
+		if (name[i] == '/')
+			return -1;
+	}
+
+	for (i = 0; i < VFS_MAX_MOUNTS; i++)
+	{
+		if (!vfs_mounts[i].used)
+		{
+			if (free == -1)
+				free = i;
+			continue;
+		}
+		if (vfs_mounts[i].name_len == len && strncmp(vfs_mounts[i].name, name, len) == 0)
+			return -1;
+	}
+	if (free == -1)
+		return -1;
+
+	memcpy(vfs_mounts[free].name, name, len + 1);
+	vfs_mounts[free].name_len = len;
+	vfs_mounts[free].ops = ops;
+	vfs_mounts[free].private = private;
+	vfs_mounts[free].used = 1;
+	return 0;
+}
+
+/*
+ * vfs_resolve
+ *   DESCRIPTION:	Finds the file system a path belongs to
+ *   INPUTS:		path - path from a system call (a leading '/' is allowed)
+ *					rest - filled with the path inside the file system
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	The mount, NULL if no file system holds the path
+ *   SIDE EFFECTS:	None
+ */
+vfs_mount_t * vfs_resolve(const uint8_t * path, const uint8_t ** rest){
+	vfs_mount_t * root = NULL;
+	int32_t i;
+
+	if (path == NULL)
+		return NULL;
+	if (path[0] == '/')
+		path++;
+
+	for (i = 0; i < VFS_MAX_MOUNTS; i++)
+	{
+		vfs_mount_t * mnt = &vfs_mounts[i];
+		uint32_t len = mnt -> name_len;
+		if (!mnt -> used)
+			continue;
+		if (len == 0)
+		{
+			root = mnt;
+			continue;
+		}
+		if (strncmp((int8_t *)path, mnt -> name, len) == 0 && (path[len] == '/' || path[len] == '\0'))
+		{
+			*rest = path + len + (path[len] == '/');
+			return mnt;
+		}
+	}
+
+	*rest = path;
+	return root;
+}
+
+/*
+ * vfs_open
+ *   DESCRIPTION:	Looks a path up and opens it with the file operations its
+ *					file system picks
+ *   INPUTS:		path - path of the file
+ *					file - file_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 if there is no such file or the driver
+ *					can't open it
+ *   SIDE EFFECTS:	file is filled
+ */
+int32_t vfs_open(const uint8_t * path, file_t * file){
+	const file_operations_t * fops = NULL;
+	const uint8_t * rest;
+	vfs_mount_t * mnt = vfs_resolve(path, &rest);
+
+	if (mnt == NULL || mnt -> ops -> lookup(mnt, rest, &file -> f_dentry, &fops) == -1 || fops == NULL)
+		return -1;
+
+	file -> f_ops = fops;
+	file -> f_private = mnt -> private;
+	file -> f_pos = 0;
+	file -> eof = 0;
+	file -> f_cloexec = 0;
+	if (fops -> open != NULL && fops -> open(file) == -1)
+		return -1;
+	return 0;
+}
+
+/*
+ * vfs_create
+ *   DESCRIPTION:	Creates an empty file
+ *   INPUTS:		path - path of the new file
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	None
+ */
+int32_t vfs_create(const uint8_t * path){
+	const uint8_t * rest;
+	vfs_mount_t * mnt = vfs_resolve(path, &rest);
+
+	if (mnt == NULL || mnt -> ops -> create == NULL)
+		return -1;
+	return mnt -> ops -> create(mnt, rest);
+}
+
+/*
+ * vfs_unlink
+ *   DESCRIPTION:	Removes a file
+ *   INPUTS:		path - path of the file
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	None
+ */
+int32_t vfs_unlink(const uint8_t * path){
+	const uint8_t * rest;
+	vfs_mount_t * mnt = vfs_resolve(path, &rest);
+
+	if (mnt == NULL || mnt -> ops -> unlink == NULL)
+		return -1;
+	return mnt -> ops -> unlink(mnt, rest);
+}
+
+/*
+ * vfs_stat
+ *   DESCRIPTION:	Gets the metadata of a file without opening it
+ *   INPUTS:		path - path of the file
+ *					buf  - stat_t to fill
+ *   OUTPUTS:		None
+ *   RETURN VALUE:	0 on success, -1 on failure
+ *   SIDE EFFECTS:	None
+ */
+int32_t vfs_stat(const uint8_t * path, stat_t * buf){
+	const file_operations_t * fops;
+	const uint8_t * rest;
+	dentry_t dentry;
+	vfs_mount_t * mnt = vfs_resolve(path, &rest);
+
+	if (mnt == NULL || mnt -> ops -> stat == NULL || mnt -> ops -> lookup(mnt, rest, &dentry, &fops) == -1)
+		return -1;
+	return mnt -> ops -> stat(mnt, &dentry, buf);
+}
@@ -0,0 +1,49 @@
+/* vfs.h
+ * Header for the virtual file system layer
+ */
+
+#ifndef _VFS_H
+#define _VFS_H
+
+#include "types.h"
+#include "lib.h"
+#include "filesystem.h"
+
+//Mounted file systems and the length of a mount name
+#define VFS_MAX_MOUNTS 8
+#define VFS_NAME_LEN 32
+
+struct vfs_mount;
+
+//Operations of a mounted file system on paths relative to its mount point.
+//lookup fills the dentry and the file operations used to open it, a NULL
+//create or unlink means the file system doesn't support it.
+typedef struct vfs_fs_ops{
+	int32_t (*lookup)(struct vfs_mount * mnt, const uint8_t * path, dentry_t * dentry, const file_operations_t ** fops);
+	int32_t (*create)(struct vfs_mount * mnt, const uint8_t * path);
+	int32_t (*unlink)(struct vfs_mount * mnt, const uint8_t * path);
+	int32_t (*stat)(struct vfs_mount * mnt, const dentry_t * dentry, stat_t * buf);
+}vfs_fs_ops_t;
+
+//Mount table entry. Paths starting with "<name>/" go to the file system,
+//the mount named "" gets every other path.
+typedef struct vfs_mount{
+	uint32_t used;
+	char name[VFS_NAME_LEN];
+	uint32_t name_len;
+	const vfs_fs_ops_t * ops;
+	void * private;			//file system state
+}vfs_mount_t;
+
+void vfs_init();
+int32_t vfs_mount(const int8_t * name, const vfs_fs_ops_t * ops, void * private);
+vfs_mount_t * vfs_resolve(const uint8_t * path, const uint8_t ** rest);
+int32_t vfs_open(const uint8_t * path, file_t * file);
+int32_t vfs_create(const uint8_t * path);
+int32_t vfs_unlink(const uint8_t * path);
+int32_t vfs_stat(const uint8_t * path, stat_t * buf);
+
+//Image file system, private is the fs_volume_t of the image
+extern const vfs_fs_ops_t fs_vfs_ops;
+
+#endif /* _VFS_H */
@@ -165,7 +165,7 @@ extern void do_invalid_TSS();
 extern void do_segment_not_present();
 extern void do_stack_segment();
 extern void do_general_protection();
-extern void do_page_fault();
+extern void do_page_fault(uint32_t error_code);
 extern void do_coprocessor_error();
 extern void do_alignment_check();
 extern void do_machine_check();